@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Scaffolding shared by the C++ benchmarks: the key and text options, the
+// synthetic keys and texts, and the timing loop.
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+#include <random>
+
+#include <fastMatch.h>
+
+typedef chrono::steady_clock Clock;
+
+static volatile size_t sink;
+
+// the options of the keys and the texts, with the defaults of a benchmark:
+//   -keys <file>   key file (default: synthetic keys)
+//   -num <n>       number of synthetic keys
+//   -min <n>       minimum synthetic key length in characters
+//   -max <n>       maximum synthetic key length in characters
+//   -ascii         synthetic keys of ASCII letters instead of CJK characters
+//   -hit <rate>    share of lookups and text bytes taken from keys
+//   -text <MB>     size of the scanned text
+struct BenchOptions {
+  string keys;
+  size_t num;
+  size_t min_len = 2;
+  size_t max_len;
+  bool ascii = false;
+  double hit;
+  size_t text_mb = 8;
+
+  BenchOptions(size_t n, size_t max, double h) : num(n), max_len(max), hit(h) {}
+
+  // take argv[i] (and its value) if it is one of the options above
+  bool parse(int argc, char** argv, int& i) {
+    string arg = argv[i];
+    bool more = i + 1 < argc;
+    if (arg == "-keys" && more)
+      keys = argv[++i];
+    else if (arg == "-num" && more)
+      num = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "-min" && more)
+      min_len = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "-max" && more)
+      max_len = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "-ascii")
+      ascii = true;
+    else if (arg == "-hit" && more)
+      hit = atof(argv[++i]);
+    else if (arg == "-text" && more)
+      text_mb = strtoul(argv[++i], nullptr, 10);
+    else
+      return false;
+    return true;
+  }
+};
+
+// one random character: a CJK ideograph (3 UTF-8 bytes) or a lowercase letter
+inline void AppendChar(string& s, mt19937& gen, bool ascii) {
+  if (ascii) {
+    s.push_back(static_cast<char>('a' + gen() % 26));
+    return;
+  }
+  unsigned c = 0x4E00 + gen() % 0x5000;
+  s.push_back(static_cast<char>(0xE0 | (c >> 12)));
+  s.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+  s.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+}
+
+// The keys of the -keys file, or o.num synthetic keys; reports the error
+// and returns false if there are none.
+inline bool LoadKeys(const BenchOptions& o, mt19937& gen, vector<string>& key) {
+  if (o.min_len == 0 || o.max_len < o.min_len || o.num == 0) {
+    cerr << "Invalid key length or number!\n";
+    return false;
+  }
+  if (o.keys.size()) {
+    ifstream in(o.keys);
+    if (!in.is_open()) {
+      cerr << "Failed to load key file!\n";
+      return false;
+    }
+    for (string line; getline(in, line);)
+      if (line.size())
+        key.push_back(line);
+  } else {
+    uniform_int_distribution<size_t> len(o.min_len, o.max_len);
+    key.resize(o.num);
+    for (auto& k : key)
+      for (size_t i = len(gen); i; --i)
+        AppendChar(k, gen, o.ascii);
+  }
+  if (key.empty()) {
+    cerr << "No keys!\n";
+    return false;
+  }
+  return true;
+}
+
+// mb MB of lines of about 100 bytes in which a share o.hit of the bytes
+// come from keys, key[pick(gen)] each
+template <class Pick>
+inline vector<string> Texts(const vector<string>& key, const BenchOptions& o, size_t mb,
+    mt19937& gen, Pick pick) {
+  uniform_real_distribution<double> coin(0, 1);
+  vector<string> text;
+  size_t total = 0, limit = mb << 20;
+  while (total < limit) {
+    string s;
+    while (s.size() < 100) {
+      if (coin(gen) < o.hit / (1 + o.hit))
+        s.append(key[pick(gen)]);
+      else
+        AppendChar(s, gen, o.ascii);
+    }
+    total += s.size() + 1;
+    text.push_back(s);
+  }
+  return text;
+}
+
+// the same with keys drawn uniformly
+inline vector<string> Texts(const vector<string>& key, const BenchOptions& o, mt19937& gen) {
+  return Texts(key, o, o.text_mb, gen, uniform_int_distribution<size_t>(0, key.size() - 1));
+}
+
+// best time per call of op over three rounds of at least 0.2 s
+inline double Measure(function<void()> op) {
+  double best = 0;
+  for (int round = 0; round < 3; ++round) {
+    size_t calls = 0;
+    auto t0 = Clock::now();
+    double seconds = 0;
+    do {
+      op();
+      ++calls;
+      seconds = chrono::duration<double>(Clock::now() - t0).count();
+    } while (seconds < 0.2);
+    double t = seconds / calls;
+    if (round == 0 || t < best)
+      best = t;
+  }
+  return best;
+}
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Trie build time versus key count: cedar update() key by key against the
+// sorted bulk builder (TrieBuilder, including the sort), on one and on
+// several threads. Key counts grow by factors of 3 up to the number of keys.
+//
+//   ./buildBench [options]
+//     -keys <file>      key file, shuffled (default: synthetic keys)
+//     -num <n>          number of synthetic keys (default 1000000)
+//     -min <n>          minimum synthetic key length in characters (default 2)
+//     -max <n>          maximum synthetic key length in characters (default 8)
+//     -ascii            synthetic keys of ASCII letters instead of CJK characters
+//     -threads <n>      threads of the parallel bulk build (default: all cores)
+
+#include "benchUtil.h"
+
+static double Seconds(Clock::time_point t0) {
+  return chrono::duration<double>(Clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+  BenchOptions o(1000000, 8, 0);
+  int threads = thread::hardware_concurrency();
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (o.parse(argc, argv, i))
+      continue;
+    if (arg == "-threads" && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else {
+      cerr << "Unknown argument: " << arg << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  mt19937 gen(42);
+  vector<string> key;
+  if (!LoadKeys(o, gen, key))
+    return EXIT_FAILURE;
+  if (o.keys.size())
+    shuffle(key.begin(), key.end(), gen);
+
+  printf("%10s %12s %12s %12s %10s %10s\n", "keys", "update s", "bulk s", "bulk*N s",
+         "nodes", "bulk nodes");
+  for (size_t n = min<size_t>(10000, key.size());; n = min(n * 3, key.size())) {
+    auto t0 = Clock::now();
+    trie da;
+    for (size_t i = 0; i < n; ++i)
+      da.update(key[i].data(), key[i].size()) = static_cast<int>(i);
+    double incremental = Seconds(t0);
+    double bulk[2];
+    size_t size = 0;
+    for (int k = 0; k < 2; ++k) {
+      t0 = Clock::now();
+      vector<KeyEntry> entry(n);
+      for (size_t i = 0; i < n; ++i)
+        entry[i] = {key[i].data(), key[i].size(), static_cast<int>(i)};
+      trie bt;
+      TrieBuilder<trie>::build(entry, bt, k ? threads : 1);
+      bulk[k] = Seconds(t0);
+      size = bt.size();
+    }
+    printf("%10zu %12.3f %12.3f %12.3f %10zu %10zu\n", n, incremental, bulk[0], bulk[1],
+           da.size(), size);
+    if (n == key.size())
+      break;
+  }
+  printf("bulk*N: %d threads\n", threads);
+  return 0;
+}
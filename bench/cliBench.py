@@ -0,0 +1,93 @@
+# coding=utf-8
+#
+# Copyright (c) 2023-present, Zejun Wang.
+# All rights reserved.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+#
+
+# Run the fastMatch binary in its default, --fast, --hit and --seg modes
+# across thread counts and record wall time, MB/s, peak RSS and scaling
+# efficiency (speedup over one thread divided by the thread count) as JSON.
+# With --compare, print the MB/s of this run against an earlier report.
+#
+#   python bench/genCorpus.py --dict dict.txt --corpus corpus.txt
+#   python bench/cliBench.py --dict dict.txt --corpus corpus.txt --report new.json \
+#       [--compare old.json]
+
+import argparse
+import json
+import os
+import platform
+import subprocess
+import time
+
+MODES = {"default": [], "fast": ["--fast"], "hit": ["--hit"], "seg": ["--seg"]}
+
+
+def run(cmd):
+    """Wall seconds and peak RSS in KB of one run of cmd."""
+    with open(os.devnull, "wb") as null:
+        start = time.perf_counter()
+        p = subprocess.Popen(cmd, stdout=null)
+        _, status, usage = os.wait4(p.pid, 0)
+        wall = time.perf_counter() - start
+    code = os.waitstatus_to_exitcode(status)
+    if code != 0:
+        raise RuntimeError("%s failed with %d" % (" ".join(cmd), code))
+    return wall, usage.ru_maxrss
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--binary", default="./fastMatch")
+    parser.add_argument("--dict", required=True)
+    parser.add_argument("--corpus", required=True)
+    parser.add_argument("--threads", default="1,2,4,8", help="comma separated thread counts")
+    parser.add_argument("--modes", default=",".join(MODES), help="comma separated modes")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per point, the best is kept")
+    parser.add_argument("--extra", default="", help="extra fastMatch arguments, e.g. --ac")
+    parser.add_argument("--report", default="cliBench.json")
+    parser.add_argument("--compare", help="earlier report to compare MB/s with")
+    args = parser.parse_args()
+
+    size = os.path.getsize(args.corpus)
+    threads = [int(t) for t in args.threads.split(",")]
+    results = []
+    print("%-8s %7s %9s %9s %10s %6s" % ("mode", "threads", "wall s", "MB/s", "RSS MB", "eff"))
+    for mode in args.modes.split(","):
+        base = None
+        for t in threads:
+            cmd = [args.binary, "--input", args.corpus, "--pattern", args.dict,
+                   "--num_threads", str(t)] + MODES[mode] + args.extra.split()
+            runs = [run(cmd) for _ in range(args.repeat)]
+            wall = min(r[0] for r in runs)
+            rss = max(r[1] for r in runs)
+            base = base or wall * t
+            res = {"mode": mode, "threads": t, "wall": wall, "mb_s": size / wall / 1048576,
+                   "peak_rss_kb": rss, "efficiency": base / (wall * t)}
+            results.append(res)
+            print("%-8s %7d %9.3f %9.1f %10.1f %6.2f" % (mode, t, wall, res["mb_s"],
+                  rss / 1024, res["efficiency"]))
+
+    report = {"binary": args.binary, "dict": args.dict, "corpus": args.corpus,
+              "corpus_bytes": size, "extra": args.extra, "host": platform.node(),
+              "cpus": os.cpu_count(), "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+              "results": results}
+    with open(args.report, "w") as f:
+        json.dump(report, f, indent=2)
+
+    if args.compare:
+        with open(args.compare) as f:
+            old = {(r["mode"], r["threads"]): r for r in json.load(f)["results"]}
+        print("\n%-8s %7s %9s %9s %7s" % ("mode", "threads", "old MB/s", "new MB/s", "ratio"))
+        for r in results:
+            o = old.get((r["mode"], r["threads"]))
+            if o:
+                print("%-8s %7d %9.1f %9.1f %7.2f" % (r["mode"], r["threads"], o["mb_s"],
+                      r["mb_s"], r["mb_s"] / o["mb_s"]))
+
+
+if __name__ == "__main__":
+    main()
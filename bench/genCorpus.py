@@ -0,0 +1,82 @@
+# coding=utf-8
+#
+# Copyright (c) 2023-present, Zejun Wang.
+# All rights reserved.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+#
+
+# Generate a synthetic dictionary and a corpus for the CLI benchmarks.
+# Dictionary terms occur in the corpus with Zipfian frequencies, lines have
+# log-normally distributed lengths, and the share of CJK characters, both in
+# terms and in the filler between them, is configurable.
+#
+#   python bench/genCorpus.py --dict dict.txt --corpus corpus.txt [options]
+
+import argparse
+import itertools
+import math
+import random
+
+# common CJK characters used as filler
+FILLER = "的一是了不在有人这中大为上个国我以要他时来用们生到作地于出就分对成会可也你而"
+
+
+def cjk_char(rng):
+    return chr(0x4E00 + rng.randrange(0x5000))
+
+
+def make_term(rng, cjk):
+    if rng.random() < cjk:
+        return "".join(cjk_char(rng) for _ in range(rng.randint(2, 6)))
+    return "".join(chr(ord("a") + rng.randrange(26)) for _ in range(rng.randint(3, 10)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--dict", required=True, help="output dictionary file")
+    parser.add_argument("--corpus", required=True, help="output corpus file")
+    parser.add_argument("--keys", type=int, default=100000, help="number of terms")
+    parser.add_argument("--lines", type=int, default=200000, help="number of corpus lines")
+    parser.add_argument("--cjk", type=float, default=0.8, help="share of CJK terms and filler")
+    parser.add_argument("--line_mean", type=float, default=60, help="mean line length in characters")
+    parser.add_argument("--line_sigma", type=float, default=0.8, help="sigma of the log line length")
+    parser.add_argument("--hit", type=float, default=0.3, help="share of line characters from terms")
+    parser.add_argument("--zipf", type=float, default=1.1, help="Zipf exponent of term frequencies")
+    parser.add_argument("--seed", type=int, default=42)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    terms = set()
+    while len(terms) < args.keys:
+        terms.add(make_term(rng, args.cjk))
+    terms = sorted(terms)
+    rng.shuffle(terms)  # the rank of a term is its position
+    with open(args.dict, "w", encoding="utf-8") as f:
+        for t in terms:
+            f.write(t + "\n")
+
+    cum = list(itertools.accumulate(1.0 / (r + 1) ** args.zipf for r in range(len(terms))))
+    mean_term = sum(len(t) for t in terms) / len(terms)
+    # a term replaces that many filler characters on average
+    p_term = args.hit / mean_term / (args.hit / mean_term + 1 - args.hit)
+    mu = math.log(max(args.line_mean, 1)) - args.line_sigma ** 2 / 2
+    with open(args.corpus, "w", encoding="utf-8") as f:
+        for _ in range(args.lines):
+            n = max(1, int(rng.lognormvariate(mu, args.line_sigma)))
+            parts, size = [], 0
+            while size < n:
+                if rng.random() < p_term:
+                    t = rng.choices(terms, cum_weights=cum)[0]
+                elif rng.random() < args.cjk:
+                    t = rng.choice(FILLER)
+                else:
+                    t = chr(ord("a") + rng.randrange(26)) if rng.random() < 0.8 else " "
+                parts.append(t)
+                size += len(t)
+            f.write("".join(parts) + "\n")
+
+
+if __name__ == "__main__":
+    main()
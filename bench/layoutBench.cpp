@@ -0,0 +1,289 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Node layout of the trie versus scan speed: hit() and parse() over texts
+// whose keys follow a Zipf distribution, on the trie as built, after
+// relayout() (breadth first) and after relayout(sample) (hottest nodes
+// first, from a sample of the same distribution). Cache misses are read
+// from the hardware counters when the kernel exposes them ("-" otherwise)
+// and simulated for the node accesses of the searches from the root:
+// 32 KB 8-way L1d, 1 MB 16-way L2 and a 64-entry 4-way TLB of 4 KB pages,
+// all LRU, as misses per KB of text. Finally, keys are inserted and
+// removed on the relaid-out trie and checked against a reference.
+//
+//   ./layoutBench [options]
+//     -keys <file>      key file (default: synthetic keys)
+//     -num <n>          number of synthetic keys (default 1000000)
+//     -min <n>          minimum synthetic key length in characters (default 2)
+//     -max <n>          maximum synthetic key length in characters (default 8)
+//     -ascii            synthetic keys of ASCII letters instead of CJK characters
+//     -hit <rate>       share of text bytes taken from keys (default 0.5)
+//     -zipf <s>         exponent of the key frequencies in texts (default 1)
+//     -text <MB>        size of the scanned text (default 8)
+//     -sample <MB>      size of the relayout sample (default 4)
+//     -insert           build with insert() key by key instead of in bulk
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "benchUtil.h"
+
+struct Options : BenchOptions {
+  double zipf = 1;
+  size_t sample_mb = 4;
+  bool insert = false;
+
+  Options() : BenchOptions(1000000, 8, 0.5) {}
+};
+
+// a hardware event of this thread; fd < 0 when the kernel or the
+// hypervisor does not expose it
+struct HwCounter {
+  int fd = -1;
+
+  HwCounter(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+  ~HwCounter() {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  void start() {
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  // the count since start(), or -1
+  double stop() {
+    uint64_t n = 0;
+    if (fd < 0)
+      return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    return read(fd, &n, sizeof(n)) == sizeof(n) ? static_cast<double>(n) : -1;
+  }
+};
+
+// a set-associative LRU cache of 2^shift-byte lines
+struct Cache {
+  size_t sets, ways, shift;
+  vector<uint64_t> line;  // per set, most recently used first; ~0: empty
+  size_t misses = 0;
+
+  Cache(size_t bytes, size_t w, size_t s)
+      : sets((bytes >> s) / w), ways(w), shift(s), line(bytes >> s, ~uint64_t(0)) {}
+
+  // whether address was cached; it is afterwards
+  bool access(uintptr_t address) {
+    uint64_t l = address >> shift;
+    uint64_t* set = &line[(l % sets) * ways];
+    size_t i = 0;
+    while (i + 1 < ways && set[i] != l)
+      ++i;
+    bool hit = set[i] == l;
+    misses += !hit;
+    memmove(set + 1, set, i * sizeof(uint64_t));
+    set[0] = l;
+    return hit;
+  }
+};
+
+// the node accesses of commonPrefixSearch from the root at every UTF-8
+// character start, through the simulated caches
+static void Simulate(const FastMatch& fm, const vector<string>& text, Cache& l1, Cache& l2,
+    Cache& tlb) {
+  const trie::node* n = static_cast<const trie::node*>(fm.array());
+  auto touch = [&](size_t i) {
+    uintptr_t a = reinterpret_cast<uintptr_t>(n + i);
+    tlb.access(a);
+    if (!l1.access(a))
+      l2.access(a);
+  };
+  for (auto& s : text)
+    for (size_t cur = 0; cur < s.size(); ++cur) {
+      if ((s[cur] & 0xC0) == 0x80)
+        continue;
+      size_t from = 0;
+      for (size_t pos = cur; pos < s.size() && s[pos]; ++pos) {
+        size_t to = n[from].base() ^ static_cast<unsigned char>(s[pos]);
+        touch(to);
+        if (n[to].check != static_cast<int>(from))
+          break;
+        touch(n[to].base());  // the value slot, label 0
+        from = to;
+      }
+    }
+}
+
+static void Report(const char* name, FastMatch& fm, const vector<string>& text, size_t bytes,
+    double seconds) {
+  double kb = bytes / 1024.0;
+  HwCounter llc(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  HwCounter l1d(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  double t[2];
+  double hw[2][2];
+  for (int m = 0; m < 2; ++m) {
+    t[m] = Measure([&] {
+      size_t n = 0;
+      for (auto& s : text)
+        n += m ? fm.parse(s).size() : fm.hit(s) >= 0;
+      sink = n;
+    });
+    l1d.start();
+    llc.start();
+    size_t n = 0;
+    for (auto& s : text)
+      n += m ? fm.parse(s).size() : fm.hit(s) >= 0;
+    sink = n;
+    hw[m][0] = l1d.stop();
+    hw[m][1] = llc.stop();
+  }
+  Cache l1(32 << 10, 8, 6), l2(1 << 20, 16, 6), tlb(64 << 12, 4, 12);
+  Simulate(fm, text, l1, l2, tlb);
+  printf("%-10s %8.3f %9.1f %9.1f", name, seconds, bytes / t[0] / 1048576.0,
+         bytes / t[1] / 1048576.0);
+  for (int m = 0; m < 2; ++m)
+    for (int k = 0; k < 2; ++k)
+      if (hw[m][k] < 0)
+        printf(" %9s", "-");
+      else
+        printf(" %9.1f", hw[m][k] / kb);
+  printf(" %9.1f %9.1f %9.1f\n", l1.misses / kb, l2.misses / kb, tlb.misses / kb);
+}
+
+// Insert keys from newKey() into fm and remove keys of key, whose ids fm
+// holds, checking the results and at the end every id against a reference
+// map. Returns the number of wrong results.
+template <class NewKey>
+static size_t CheckUpdates(FastMatch& fm, const vector<string>& key, size_t ops, mt19937& gen,
+    NewKey newKey) {
+  map<string, int> ref;
+  for (size_t i = 0; i < key.size(); ++i)
+    ref[key[i]] = static_cast<int>(i);
+  size_t wrong = 0;
+  for (size_t n = 0; n < ops; ++n) {
+    if (n % 2) {
+      string k = key[gen() % key.size()];
+      wrong += (fm.remove(k) == 0) != (ref.erase(k) == 1);
+    } else {
+      string k = newKey();
+      int id = ref.count(k) ? ref[k] : static_cast<int>(fm.size());
+      wrong += fm.insert(k) != id;
+      ref[k] = id;
+    }
+  }
+  for (auto& k : ref)
+    wrong += fm.getValue(k.first) != k.second;
+  return wrong;
+}
+
+// 1 to 5 bytes of letters, punctuation and UTF-8 lead bytes, so that small
+// dictionaries have many first bytes
+static string MixedKey(mt19937& gen) {
+  string k;
+  for (size_t i = 1 + gen() % 5; i; --i) {
+    unsigned r = gen() % 10;
+    k.push_back(static_cast<char>(r < 7 ? 'a' + gen() % 6 : r < 9 ? ' ' + gen() % 16 :
+                                  0xE4 + gen() % 3));
+  }
+  return k;
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    bool more = i + 1 < argc;
+    if (o.parse(argc, argv, i))
+      continue;
+    if (arg == "-zipf" && more)
+      o.zipf = atof(argv[++i]);
+    else if (arg == "-sample" && more)
+      o.sample_mb = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "-insert")
+      o.insert = true;
+    else {
+      cerr << "Unknown argument: " << arg << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  mt19937 gen(42);
+  vector<string> key;
+  if (!LoadKeys(o, gen, key))
+    return EXIT_FAILURE;
+  // the ranks of the Zipf distribution, independent of the key order
+  vector<string> rank(key);
+  shuffle(rank.begin(), rank.end(), gen);
+  vector<double> weight(rank.size());
+  for (size_t r = 0; r < weight.size(); ++r)
+    weight[r] = pow(r + 1.0, -o.zipf);
+  discrete_distribution<size_t> zipf(weight.begin(), weight.end());
+  vector<string> text = Texts(rank, o, o.text_mb, gen, zipf);
+  vector<string> sample = Texts(rank, o, o.sample_mb, gen, zipf);
+  size_t bytes = 0;
+  for (auto& s : text)
+    bytes += s.size();
+
+  auto t0 = Clock::now();
+  unique_ptr<FastMatch> built(o.insert ? new FastMatch() : new FastMatch(key));
+  FastMatch& fm = *built;
+  if (o.insert)
+    for (auto& k : key)
+      fm.insert(k);
+  double seconds = chrono::duration<double>(Clock::now() - t0).count();
+  printf("%zu keys, trie %.1f MB, %.1f MB of text, hit rate %.2f, zipf %.2f\n", key.size(),
+         fm.memoryUsage().nodes / 1048576.0, bytes / 1048576.0, o.hit, o.zipf);
+  printf("%-10s %8s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n", "layout", "build s", "hit MB/s",
+         "parse MB/s", "hit L1d", "hit LLC", "parse L1d", "parse LLC", "sim L1d", "sim L2",
+         "sim TLB");
+  Report(o.insert ? "insert" : "bulk", fm, text, bytes, seconds);
+  t0 = Clock::now();
+  fm.relayout();
+  seconds = chrono::duration<double>(Clock::now() - t0).count();
+  Report("bfs", fm, text, bytes, seconds);
+  t0 = Clock::now();
+  fm.relayout(sample);
+  seconds = chrono::duration<double>(Clock::now() - t0).count();
+  Report("sample", fm, text, bytes, seconds);
+  printf("hardware and simulated misses per KB of text\n");
+  // updates of the relaid-out trie, with keys of new first bytes, and of
+  // small dictionaries, in which a new first byte soon needs a slot next
+  // to the children of the root
+  size_t wrong = CheckUpdates(fm, key, 1000, gen, [&] {
+    string k(1, static_cast<char>(' ' + gen() % 32));
+    for (size_t i = 1 + gen() % o.max_len; i; --i)
+      AppendChar(k, gen, o.ascii);
+    return k;
+  });
+  for (int d = 0; d < 600; ++d) {
+    vector<string> small(1 + gen() % 400);
+    for (auto& k : small)
+      k = MixedKey(gen);
+    FastMatch sm(small);
+    vector<string> hot(50);
+    for (auto& s : hot)
+      for (int i = 0; i < 4; ++i)
+        s += small[gen() % small.size()] + MixedKey(gen);
+    sm.relayout(d % 2 ? hot : vector<string>());
+    wrong += CheckUpdates(sm, small, 300, gen, [&] { return MixedKey(gen); });
+  }
+  printf("updates after relayout: %s\n", wrong ? "FAILED" : "ok");
+  return wrong ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,220 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Micro-benchmarks of the cedar primitives and of the FastMatch matching
+// methods, reported in ns/op and, for text scans, MB/s. Each measurement
+// repeats its operation for at least 0.2 s and keeps the best of three
+// rounds.
+//
+//   ./microBench [options]
+//     -keys <file>      key file (default: synthetic keys)
+//     -num <n>          number of synthetic keys (default 100000)
+//     -min <n>          minimum synthetic key length in characters (default 2)
+//     -max <n>          maximum synthetic key length in characters (default 6)
+//     -ascii            synthetic keys of ASCII letters instead of CJK characters
+//     -hit <rate>       share of lookups and text bytes taken from keys (default 0.3)
+//     -text <MB>        size of the scanned text (default 8)
+//     -freeze           freeze the trie into a StaticTrie before measuring
+//     -compact          replace the key table by value nodes (compactKeys())
+//
+// bench/microBenchPrefix is the same benchmark built with USE_PREFIX_TRIE,
+// on the tail-compressed trie of cedarpp.h.
+
+#include "benchUtil.h"
+
+struct Options : BenchOptions {
+  bool freeze = false;
+  bool compact = false;
+
+  Options() : BenchOptions(100000, 6, 0.3) {}
+};
+
+// misses: keys of the same shape that are not in the dictionary
+static vector<string> Misses(const vector<string>& key, const FastMatch& fm, bool ascii,
+    mt19937& gen) {
+  vector<string> res;
+  res.reserve(key.size());
+  for (auto& k : key) {
+    string s;
+    size_t n = max<size_t>(charCount(k.data(), k.size()), 1);
+    // grow the query when short keys leave no miss of the same length
+    for (int tries = 0; s.empty() || fm.getValue(s) >= 0; ++tries) {
+      if (tries < 16)
+        s.clear();
+      for (size_t i = tries < 16 ? 0 : n - 1; i < n; ++i)
+        AppendChar(s, gen, ascii);
+    }
+    res.push_back(s);
+  }
+  return res;
+}
+
+static void Print(const char* name, double seconds, size_t ops, size_t bytes = 0) {
+  printf("%-24s %10.1f ns/op", name, seconds * 1e9 / ops);
+  if (bytes)
+    printf(" %10.1f MB/s", bytes / seconds / 1048576.0);
+  printf("\n");
+}
+
+// time exactMatchSearch and commonPrefixSearch of every query
+template <class Trie>
+static void Lookups(const Trie& da, const vector<string>& query) {
+  double t = Measure([&] {
+    size_t n = 0;
+    for (auto& q : query)
+      n += da.template exactMatchSearch<int>(q.data(), q.size()) >= 0;
+    sink = n;
+  });
+  Print("exactMatchSearch", t, query.size());
+  t = Measure([&] {
+    trie::result_pair_type result[maxPrefixMatches];
+    size_t n = 0;
+    for (auto& q : query)
+      n += da.commonPrefixSearch(q.data(), result, maxPrefixMatches, q.size());
+    sink = n;
+  });
+  Print("commonPrefixSearch", t, query.size());
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (o.parse(argc, argv, i))
+      continue;
+    if (arg == "-freeze")
+      o.freeze = true;
+    else if (arg == "-compact")
+      o.compact = true;
+    else {
+      cerr << "Unknown argument: " << arg << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+  if (o.freeze && o.compact) {
+    cerr << "A frozen trie cannot have compact keys!\n";
+    return EXIT_FAILURE;
+  }
+
+  mt19937 gen(42);
+  vector<string> key;
+  if (!LoadKeys(o, gen, key))
+    return EXIT_FAILURE;
+  FastMatch fm(key);
+  vector<string> miss = Misses(key, fm, o.ascii, gen);
+  vector<string> text = Texts(key, o, gen);
+  size_t bytes = 0;
+  for (auto& s : text)
+    bytes += s.size();
+  printf("%zu keys, %zu texts, %.1f MB, hit rate %.2f\n", key.size(), text.size(),
+         bytes / 1048576.0, o.hit);
+
+  // lookups: a share hit of the queries are keys
+  vector<string> query(key.size());
+  uniform_real_distribution<double> coin(0, 1);
+  for (size_t i = 0; i < query.size(); ++i)
+    query[i] = coin(gen) < o.hit ? key[i] : miss[i];
+  shuffle(query.begin(), query.end(), gen);
+
+  MemoryUsage usage = fm.memoryUsage();
+  printf("trie %.1f MB (%zu slots, %zu nodes, tail %.1f MB), key table %.1f MB\n",
+         (usage.nodes + usage.tail + usage.ninfo + usage.blocks) / 1048576.0, fm.trie::size(),
+         fm.nonzero_size(), usage.tail / 1048576.0, usage.keys / 1048576.0);
+  if (o.freeze) {
+    auto t0 = Clock::now();
+    if (fm.freeze() != 0) {
+      cerr << "Failed to freeze the trie!\n";
+      return EXIT_FAILURE;
+    }
+    double s = chrono::duration<double>(Clock::now() - t0).count();
+    printf("frozen trie %.1f MB (%zu units) in %.3f s\n",
+           fm.staticTrie()->total_size() / 1048576.0, fm.staticTrie()->size(), s);
+  }
+
+  if (o.compact) {
+    auto t0 = Clock::now();
+    fm.compactKeys();
+    double s = chrono::duration<double>(Clock::now() - t0).count();
+    printf("compact keys %.1f MB in %.3f s\n", fm.memoryUsage().keys / 1048576.0, s);
+  }
+
+  // lookups, in the trie the matching methods use
+  if (o.freeze)
+    Lookups(*fm.staticTrie(), query);
+  else
+    Lookups<trie>(fm, query);
+
+  // update and erase on a fresh trie each round, so every call does work
+  double t = Measure([&] {
+    trie da;
+    for (size_t i = 0; i < key.size(); ++i)
+      da.update(key[i].data(), key[i].size(), static_cast<int>(i));
+    sink = da.size();
+  });
+  Print("update", t, key.size());
+  {
+    double best = 0;
+    for (int round = 0; round < 3; ++round) {
+      trie da;
+      for (size_t i = 0; i < key.size(); ++i)
+        da.update(key[i].data(), key[i].size(), static_cast<int>(i));
+      auto t0 = Clock::now();
+      for (auto& k : key)
+        da.erase(k.data(), k.size());
+      double s = chrono::duration<double>(Clock::now() - t0).count();
+      if (round == 0 || s < best)
+        best = s;
+    }
+    Print("erase", best, key.size());
+  }
+
+  // FastMatch methods: keys by id, then over the texts
+  t = Measure([&] {
+    size_t n = 0;
+    for (size_t i = 0; i < fm.size(); ++i)
+      n += fm.getKey(static_cast<int>(i)).size();
+    sink = n;
+  });
+  Print("getKey", t, fm.size());
+  t = Measure([&] {
+    size_t n = 0;
+    for (auto& s : text)
+      n += fm.hit(s) >= 0;
+    sink = n;
+  });
+  Print("hit", t, text.size(), bytes);
+  t = Measure([&] {
+    size_t n = 0;
+    for (auto& s : text)
+      n += fm.parse(s).size();
+    sink = n;
+  });
+  Print("parse", t, text.size(), bytes);
+  t = Measure([&] {
+    size_t n = 0;
+    for (auto& s : text)
+      n += fm.parse2(s).size();
+    sink = n;
+  });
+  Print("parse2", t, text.size(), bytes);
+  t = Measure([&] {
+    size_t n = 0;
+    for (auto& s : text)
+      n += fm.maxForwardMatch(s).size();
+    sink = n;
+  });
+  Print("maxForwardMatch", t, text.size(), bytes);
+  t = Measure([&] {
+    size_t n = 0;
+    for (auto& s : text)
+      fm.forEachMatch(s, [&](int, size_t, size_t) { ++n; });
+    sink = n;
+  });
+  Print("forEachMatch", t, text.size(), bytes);
+  return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Page size of the trie arrays versus lookup and scan speed: exact lookups
+// of random keys, hit() and parse() over texts that draw keys uniformly, with
+// the trie in 4 KB pages, in transparent huge pages and in reserved huge
+// pages (FastMatch::setPages()). The dictionary should be larger than the
+// last level cache for the TLB to matter. Reserved huge pages need
+// /proc/sys/vm/nr_hugepages; without them the arrays fall back to
+// transparent ones, which the "hugetlb MB" column shows.
+//
+//   ./pageBench [options]
+//     -keys <file>      key file (default: synthetic keys)
+//     -num <n>          number of synthetic keys (default 2000000)
+//     -min <n>          minimum synthetic key length in characters (default 2)
+//     -max <n>          maximum synthetic key length in characters (default 8)
+//     -ascii            synthetic keys of ASCII letters instead of CJK characters
+//     -hit <rate>       share of lookups and text bytes taken from keys (default 0.5)
+//     -text <MB>        size of the scanned text (default 8)
+//     -index <file>     save the trie to this index file and measure load() from it
+
+#include "benchUtil.h"
+
+struct Options : BenchOptions {
+  string index;
+
+  Options() : BenchOptions(2000000, 8, 0.5) {}
+};
+
+// a "Name:   123 kB" line of a /proc file in MB, or -1
+static double ProcMB(const char* path, const char* name) {
+  ifstream in(path);
+  size_t n = strlen(name);
+  for (string line; getline(in, line);)
+    if (line.compare(0, n, name) == 0 && line.size() > n && line[n] == ':')
+      return atof(line.c_str() + n + 1) / 1024;
+  return -1;
+}
+
+static const char* PageName(trie::page_type pages) {
+  return pages == trie::SMALL_PAGES ? "4 KB" : pages == trie::HUGE_PAGES ? "thp" : "hugetlb";
+}
+
+static void Report(trie::page_type pages, const FastMatch& fm, const vector<string>& probe,
+    const vector<string>& text, size_t bytes, double seconds) {
+  double exact = Measure([&] {
+    size_t n = 0;
+    for (auto& p : probe)
+      n += fm.exactMatchSearch<int>(p.data(), p.size()) >= 0;
+    sink = n;
+  }) / probe.size();
+  double hit = Measure([&] {
+    size_t n = 0;
+    for (auto& s : text)
+      n += fm.hit(s) >= 0;
+    sink = n;
+  });
+  double parse = Measure([&] {
+    size_t n = 0;
+    for (auto& s : text)
+      n += fm.parse(s).size();
+    sink = n;
+  });
+  printf("%-8s %8.3f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", PageName(pages), seconds,
+         fm.memoryUsage().huge / 1048576.0, ProcMB("/proc/self/smaps_rollup", "AnonHugePages"),
+         ProcMB("/proc/self/status", "HugetlbPages"), exact * 1e9, bytes / hit / 1048576.0,
+         bytes / parse / 1048576.0);
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (o.parse(argc, argv, i))
+      continue;
+    if (arg == "-index" && i + 1 < argc)
+      o.index = argv[++i];
+    else {
+      cerr << "Unknown argument: " << arg << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  mt19937 gen(42);
+  vector<string> key;
+  if (!LoadKeys(o, gen, key))
+    return EXIT_FAILURE;
+  // lookups of keys and of random strings
+  uniform_real_distribution<double> coin(0, 1);
+  vector<string> probe(1 << 16);
+  for (auto& p : probe) {
+    if (coin(gen) < o.hit) {
+      p = key[gen() % key.size()];
+    } else {
+      for (size_t i = o.min_len; i; --i)
+        AppendChar(p, gen, o.ascii);
+    }
+  }
+  vector<string> text = Texts(key, o, gen);
+  size_t bytes = 0;
+  for (auto& s : text)
+    bytes += s.size();
+
+  unique_ptr<FastMatch> built(new FastMatch(key));
+  printf("%zu keys, trie %.1f MB, %.1f MB of text, hit rate %.2f\n", key.size(),
+         built->memoryUsage().nodes / 1048576.0, bytes / 1048576.0, o.hit);
+  printf("%-8s %8s %10s %10s %10s %10s %10s %10s\n", "pages", o.index.size() ? "load s" : "move s",
+         "huge MB", "thp MB", "hugetlb MB", "exact ns", "hit MB/s", "parse MB/s");
+  if (o.index.size() && built->save(o.index) < 0) {
+    cerr << "Failed to save index!\n";
+    return EXIT_FAILURE;
+  }
+  const trie::page_type type[3] = {trie::SMALL_PAGES, trie::HUGE_PAGES, trie::HUGETLB_PAGES};
+  for (auto pages : type) {
+    auto t0 = Clock::now();
+    if (o.index.size()) {
+      built.reset(new FastMatch());
+      built->setPages(pages);
+      if (built->load(o.index) < 0) {
+        cerr << "Failed to load index!\n";
+        return EXIT_FAILURE;
+      }
+    } else {
+      built->setPages(pages);
+    }
+    double seconds = chrono::duration<double>(Clock::now() - t0).count();
+    Report(pages, *built, probe, text, bytes, seconds);
+  }
+  return 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Compare the static partitioning of RunMultiThread with the byte-balanced
+// chunk scheduler of RunChunked on a skewed corpus: mostly short lines plus
+// a cluster of 200 KB - 2 MB documents at the front of the input.
+//
+//   ./schedulerBench [key file] [num_threads]
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+
+#include <fastMatch.h>
+
+typedef chrono::steady_clock Clock;
+
+static double Seconds(Clock::time_point a, Clock::time_point b) {
+  return chrono::duration<double>(b - a).count();
+}
+
+static vector<string> SkewedCorpus(const vector<string>& key, size_t n, size_t num_long) {
+  mt19937 gen(42);
+  uniform_int_distribution<size_t> pick(0, key.size() - 1);
+  uniform_int_distribution<size_t> shortLen(20, 200), longLen(200 << 10, 2 << 20);
+  const string filler = "的了在是和有";
+  vector<string> text(n);
+  for (size_t i = 0; i < n; ++i) {
+    size_t len = i < num_long ? longLen(gen) : shortLen(gen);
+    string& s = text[i];
+    s.reserve(len + 64);
+    while (s.size() < len) {
+      if (gen() & 1)
+        s.append(key[pick(gen)]);
+      else
+        s.append(filler, 3 * (gen() % 6), 3);
+    }
+  }
+  return text;
+}
+
+struct Report {
+  double wall = 0;
+  vector<double> busy;
+  size_t bytes = 0;
+};
+
+static void Print(const char* name, const Report& r, int num_threads) {
+  double sum = 0, lo = r.wall, hi = 0;
+  for (double b : r.busy) {
+    sum += b;
+    lo = min(lo, b);
+    hi = max(hi, b);
+  }
+  double idle = 1 - sum / (r.wall * num_threads);
+  printf("%-8s wall %8.3fs  busy min/max %7.3fs / %7.3fs  tail idle %5.1f%%  output %zu\n",
+         name, r.wall, lo, hi, 100 * idle, r.bytes);
+}
+
+int main(int argc, char** argv) {
+  string path = argc > 1 ? argv[1] : "data/disease.txt";
+  int num_threads = argc > 2 ? atoi(argv[2]) : thread::hardware_concurrency();
+  if (num_threads <= 0)
+    num_threads = 1;
+  vector<string> key;
+  ifstream in(path);
+  if (!in.is_open()) {
+    cerr << "Failed to load key file!\n";
+    return EXIT_FAILURE;
+  }
+  for (string line; getline(in, line);)
+    if (line.size())
+      key.push_back(line);
+  FastMatch fastMatch(key);
+  vector<string> text = SkewedCorpus(key, 200000, 64);
+  size_t total = 0;
+  for (auto& s : text)
+    total += s.size();
+  printf("%zu texts, %.1f MB, %d threads\n", text.size(), total / 1048576.0, num_threads);
+
+  auto bench = [&](function<void(function<void(size_t, size_t)>)> schedule) {
+    Report r;
+    map<thread::id, double> busy;
+    mutex m;
+    auto start = Clock::now();
+    schedule([&](size_t lo, size_t hi) {
+      auto t0 = Clock::now();
+      size_t bytes = 0;
+      for (size_t i = lo; i < hi; ++i)
+        bytes += fastMatch.parseSingle(text[i]).size();
+      auto t1 = Clock::now();
+      lock_guard<mutex> lock(m);
+      busy[this_thread::get_id()] += Seconds(t0, t1);
+      r.bytes += bytes;
+    });
+    r.wall = Seconds(start, Clock::now());
+    for (auto& b : busy)
+      r.busy.push_back(b.second);
+    r.busy.resize(num_threads, 0);
+    return r;
+  };
+
+  Report s = bench([&](function<void(size_t, size_t)> f) {
+    RunMultiThread(f, text.size(), num_threads);
+  });
+  Report c = bench([&](function<void(size_t, size_t)> f) {
+    RunChunked(f, ChunkBounds(text, num_threads), num_threads);
+  });
+  Print("static", s, num_threads);
+  Print("chunked", c, num_threads);
+  return 0;
+}
@@ -0,0 +1,85 @@
+# coding=utf-8
+#
+# Copyright (c) 2023-present, Zejun Wang.
+# All rights reserved.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+#
+
+# Call FastMatch.parse() on one shared instance from 1, 2, 4, ... Python
+# threads and report the throughput and the speedup over one thread. The
+# matching methods run without the GIL, so the speedup should stay close to
+# the number of threads up to the number of cores. The results of every
+# thread are checked against a single-threaded run.
+#
+#   python bench/threadBench.py [key file] [max_threads] [num_texts]
+
+import os
+import random
+import sys
+import threading
+import time
+
+from fast_match import FastMatch
+
+
+def make_texts(keys, n):
+    rng = random.Random(42)
+    filler = "的了在是和有"
+    texts = []
+    for _ in range(n):
+        parts = []
+        for _ in range(rng.randint(20, 60)):
+            parts.append(rng.choice(keys) if rng.random() < 0.3 else rng.choice(filler))
+        texts.append("".join(parts))
+    return texts
+
+
+def run(fmatch, texts, num_threads, rounds):
+    results = [None] * num_threads
+    barrier = threading.Barrier(num_threads + 1)
+
+    def worker(i):
+        barrier.wait()
+        res = []
+        for _ in range(rounds):
+            res = [len(fmatch.parse(t)) for t in texts]
+        results[i] = res
+
+    threads = [threading.Thread(target=worker, args=(i,)) for i in range(num_threads)]
+    for t in threads:
+        t.start()
+    barrier.wait()
+    start = time.perf_counter()
+    for t in threads:
+        t.join()
+    return time.perf_counter() - start, results
+
+
+def main():
+    key_file = sys.argv[1] if len(sys.argv) > 1 else "data/disease.txt"
+    max_threads = int(sys.argv[2]) if len(sys.argv) > 2 else os.cpu_count()
+    num_texts = int(sys.argv[3]) if len(sys.argv) > 3 else 20000
+    with open(key_file, encoding="utf-8") as f:
+        keys = [line.strip() for line in f if line.strip()]
+    fmatch = FastMatch(key_file)
+    texts = make_texts(keys, num_texts)
+    expected = [len(fmatch.parse(t)) for t in texts]
+    rounds = 3
+    base = None
+    num_threads = 1
+    print("threads  texts/s      speedup")
+    while num_threads <= max_threads:
+        seconds, results = run(fmatch, texts, num_threads, rounds)
+        for res in results:
+            if res != expected:
+                sys.exit("thread results differ from the single-threaded run")
+        rate = num_threads * rounds * len(texts) / seconds
+        base = base or rate
+        print("%7d  %-11.0f  %.2fx" % (num_threads, rate, rate / base))
+        num_threads *= 2
+
+
+if __name__ == "__main__":
+    main()
@@ -6,16 +6,28 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
 #include <memory>
 #include <args.h>
 #include <fastMatch.h>
+#include <numaMatch.h>
+#include <stats.h>
+
+// number of '\t'-separated matches in the output line of a text
+inline size_t CountTabs(const string& text, const char* out, size_t len) {
+  return count(out, out + len, '\t') - count(text.begin(), text.end(), '\t');
+}
 
 int main(int argc, char** argv) {
   vector<string> args(argv, argv + argc);
   Args a(args);
-  // load text strings
+  unique_ptr<Stats> stats;
+  if (a.stats || a.stats_json.size())
+    stats.reset(new Stats());
+  int num_threads = a.num_threads > 0 ? a.num_threads : thread::hardware_concurrency();
+  // load text strings; in streaming mode they are read batch by batch
   vector<string> text;
-  if (a.N)
+  if (a.N && !a.stream)
     text.reserve(a.N);
   ifstream textIn(a.input);
   if (!textIn.good()) {
@@ -23,23 +35,116 @@ int main(int argc, char** argv) {
     exit(EXIT_FAILURE);
   }
   string str;
-  while (getline(textIn, str))
+  while (!a.stream && getline(textIn, str))
     text.emplace_back(str);
-  // single pattern string
+  if (stats)
+    stats->stage("read");
+  // the output function of the mode and the number of matches in its output
+  Stats::Func func;
+  Stats::Counter counter;
+  shared_ptr<FastMatch> fastMatch;
+  shared_ptr<NumaMatch> numa;
   ifstream ifs(a.pattern);
   if (!ifs.good()) {
-    SingleMatch(text, a.pattern, a.num_threads);
-    return 0;
-  }
-  // multi-pattern matching
-  shared_ptr<FastMatch> fastMatch = make_shared<FastMatch>(a.pattern, a.M);
-  if (a.seg) {
-    fastMatch->maxForwardMatch(text, a.num_threads);
-  } else if (a.hit) {
-    fastMatch->parseHit(text, a.num_threads);
+    // single pattern string
+    string pattern = a.pattern;
+    func = [pattern](const string& s, string& out) { formatSingleMatch(s, pattern, out); };
+    counter = [](const string&, const char*, size_t) { return static_cast<size_t>(1); };
   } else {
-    fastMatch->parse(text, a.fast, a.num_patterns, a.num_threads);
+    // multi-pattern matching
+    trie::page_type pages = static_cast<trie::page_type>(a.huge_pages);
+    if (FastMatch::isIndex(a.pattern)) {
+      fastMatch = make_shared<FastMatch>();
+      if (a.huge_pages)
+        fastMatch->setPages(pages);
+      if (fastMatch->load(a.pattern) < 0) {
+        cerr << "Failed to load pattern index!" << endl;
+        exit(EXIT_FAILURE);
+      }
+      if (stats)
+        stats->stage("load");
+    } else {
+      // read the keys before building so that both are timed on their own
+      vector<string> key;
+      if (a.M)
+        key.reserve(a.M);
+      while (getline(ifs, str))
+        if (str.size())
+          key.emplace_back(str);
+      if (stats)
+        stats->stage("read keys");
+      fastMatch = make_shared<FastMatch>(key, num_threads);
+      if (a.huge_pages)
+        fastMatch->setPages(pages);
+      if (stats)
+        stats->stage("build");
+    }
+    if (a.save.size()) {
+      if (fastMatch->save(a.save) < 0) {
+        cerr << "Failed to save pattern index!" << endl;
+        exit(EXIT_FAILURE);
+      }
+      if (stats)
+        stats->stage("save");
+    }
+    if (a.ac)
+      fastMatch->buildAutomaton();
+    else if (a.teddy)
+      fastMatch->buildTeddy();
+    if (a.numa)
+      numa = make_shared<NumaMatch>(fastMatch);
+    if (stats && (a.ac || a.teddy || a.numa))
+      stats->stage("prepare");
+    // with --numa, every worker matches against the replica on its node
+    const NumaMatch* replicas = numa.get();
+    const FastMatch* base = fastMatch.get();
+    auto local = [replicas, base]() -> const FastMatch& {
+      return replicas ? replicas->local() : *base;
+    };
+    if (a.seg) {
+      func = [local](const string& s, string& out) {
+        out.append(local().maxForwardMatchSingle(s));
+      };
+      // segments found in the dictionary; the other segments are single
+      // characters or ASCII runs that no key matched
+      counter = [local](const string& s, const char*, size_t) {
+        size_t n = 0;
+        local().forEachSegment(s, [&](int id, size_t, size_t) { n += id >= 0; });
+        return n;
+      };
+    } else if (a.hit) {
+      func = [local](const string& s, string& out) { local().formatHit(s, out); };
+      counter = [](const string&, const char*, size_t len) {
+        return static_cast<size_t>(len ? 1 : 0);
+      };
+    } else {
+      bool fast = a.fast;
+      int num_patterns = a.num_patterns;
+      func = [local, fast, num_patterns](const string& s, string& out) {
+        local().formatParse(s, fast, num_patterns, out);
+      };
+      counter = CountTabs;
+    }
+  }
+  if (stats)
+    func = stats->wrap(func, counter);
+  bool written = true;
+  if (a.stream)
+    written = RunPipeline(textIn, STDOUT_FILENO, func, num_threads, a.batch, a.numa);
+  else if (text.size())
+    written = RunOrdered(text, func, num_threads, a.numa);
+  if (!written) {
+    cerr << "Failed to write output!" << endl;
+    exit(EXIT_FAILURE);
+  }
+  if (stats) {
+    stats->stage("match");
+    if (a.stats)
+      stats->print(stderr);
+    if (a.stats_json.size() && !stats->writeJson(a.stats_json)) {
+      cerr << "Failed to write stats!" << endl;
+      exit(EXIT_FAILURE);
+    }
   }
   return 0;
 }
-
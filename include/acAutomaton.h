@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef AC_AUTOMATON_H
+#define AC_AUTOMATON_H
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ACMatch {
+  int value;
+  size_t start;
+  size_t length;
+};
+
+// Per-thread match buffer reused across searches, so that scanning a text
+// does not allocate once the buffer has grown. Nested scopes on the same
+// thread, e.g. a search started from a match visitor, get their own buffer.
+class ACBuffer {
+  public:
+  ACBuffer() : _level(depth()++) {
+    if (pool().size() <= _level)
+      pool().emplace_back();
+  }
+  ~ACBuffer() { --depth(); }
+  ACBuffer(const ACBuffer&) = delete;
+  ACBuffer& operator=(const ACBuffer&) = delete;
+
+  std::vector<ACMatch>& get() { return pool()[_level]; }
+
+  private:
+  static size_t& depth() {
+    static thread_local size_t n = 0;
+    return n;
+  }
+  static std::deque<std::vector<ACMatch>>& pool() {
+    static thread_local std::deque<std::vector<ACMatch>> p;
+    return p;
+  }
+
+  size_t _level;
+};
+
+// Byte-level Aho-Corasick automaton stored as flat arrays. The outgoing
+// edges of a state are kept contiguous and sorted by label, and failure
+// links let a whole text be scanned in one left-to-right pass.
+class ACAutomaton {
+  public:
+  ACAutomaton() {}
+
+  void build(const std::vector<std::pair<std::string, int>>& keys) {
+    clear();
+    size_t n = keys.size();
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i)
+      order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return keys[a].first < keys[b].first;
+    });
+    // goto function numbered in depth-first order, so that the single-child
+    // chains of long keys are laid out contiguously
+    struct range { size_t lo, hi; int depth, edge; };
+    std::vector<range> stack(1, range{0, n, 0, -1});
+    std::vector<int> value;
+    while (!stack.empty()) {
+      range r = stack.back();
+      stack.pop_back();
+      int t = static_cast<int>(_state.size());
+      if (r.edge >= 0)
+        _edge[r.edge].next = t;
+      _state.push_back(state());
+      _state[t].depth = r.depth;
+      value.push_back(-1);
+      size_t lo = r.lo, hi = r.hi, d = r.depth;
+      while (lo < hi && keys[order[lo]].first.size() == d)
+        value[t] = keys[order[lo++]].second;
+      _state[t].begin = static_cast<int>(_edge.size());
+      size_t top = stack.size();
+      while (lo < hi) {
+        unsigned char c = keys[order[lo]].first[d];
+        size_t mid = lo + 1;
+        while (mid < hi && static_cast<unsigned char>(keys[order[mid]].first[d]) == c)
+          ++mid;
+        stack.push_back({lo, mid, r.depth + 1, static_cast<int>(_edge.size())});
+        _edge.push_back({-1, c});
+        lo = mid;
+      }
+      _state[t].end = static_cast<int>(_edge.size());
+      std::reverse(stack.begin() + top, stack.end());
+    }
+    _maxDepth = 0;
+    for (size_t s = 0; s < _state.size(); ++s)
+      _maxDepth = std::max(_maxDepth, static_cast<size_t>(_state[s].depth));
+    for (int i = _state[0].begin; i < _state[0].end; ++i)
+      _root[_edge[i].label] = _edge[i].next;
+    // failure and output links in BFS order
+    size_t num = _state.size();
+    _link.assign(num, -1);
+    std::deque<int> queue(1, 0);
+    while (!queue.empty()) {
+      int s = queue.front();
+      queue.pop_front();
+      for (int i = _state[s].begin; i < _state[s].end; ++i) {
+        int t = _edge[i].next, f = 0;
+        if (s) {
+          f = _state[s].fail;
+          int g = transition(f, _edge[i].label);
+          while (g < 0 && f) {
+            f = _state[f].fail;
+            g = transition(f, _edge[i].label);
+          }
+          f = g < 0 ? 0 : g;
+        }
+        _state[t].fail = f;
+        _link[t] = value[f] >= 0 ? f : _link[f];
+        queue.push_back(t);
+      }
+    }
+    // each state starts the chain of states whose keys end here
+    for (size_t s = 0; s < num; ++s)
+      _state[s].emit = value[s] >= 0 ? static_cast<int>(s) : _link[s];
+    _value.swap(value);
+  }
+
+  void clear() {
+    std::fill(_root, _root + 256, 0);
+    _maxDepth = 0;
+    _state.clear();
+    _edge.clear();
+    _value.clear();
+    _link.clear();
+  }
+
+  bool empty() const { return _state.empty(); }
+  size_t numStates() const { return _state.size(); }
+  size_t maxDepth() const { return _maxDepth; }
+  size_t memoryUsage() const {
+    return sizeof(*this) + _state.capacity() * sizeof(state) + _edge.capacity() * sizeof(edge) +
+           (_value.capacity() + _link.capacity()) * sizeof(int);
+  }
+
+  // Collect all matches ordered by start and then by length. With
+  // first = true only the matches at the leftmost UTF-8 character boundary
+  // are kept and scanning stops as soon as that start is settled.
+  void search(const char* str, size_t len, std::vector<ACMatch>& res,
+      bool first = false) const {
+    res.clear();
+    if (empty())
+      return;
+    size_t best = len, limit = maxDepth();
+    int s = 0;
+    for (size_t i = 0; i < len; ++i) {
+      if (first && best < len && i >= best + limit)
+        break;
+      unsigned char c = static_cast<unsigned char>(str[i]);
+      int t = _root[c];
+      if (s) {
+        while ((t = transition(s, c)) < 0 && s)
+          s = _state[s].fail;
+        if (t < 0)
+          t = _root[c];
+      }
+      s = t;
+      for (int o = _state[s].emit; o > 0; o = _link[o]) {
+        size_t start = i + 1 - _state[o].depth;
+        if (first) {
+          if (start && (str[start] & 0xC0) == 0x80)
+            continue;
+          if (start > best)
+            continue;
+          if (start < best) {
+            res.clear();
+            best = start;
+          }
+        }
+        res.push_back({_value[o], start, static_cast<size_t>(_state[o].depth)});
+      }
+    }
+    std::sort(res.begin(), res.end(), [](const ACMatch& a, const ACMatch& b) {
+      return a.start < b.start || (a.start == b.start && a.length < b.length);
+    });
+  }
+
+  private:
+  struct state {
+    int begin = 0, end = 0; // outgoing edges
+    int fail = 0;
+    int emit = -1;          // first state on the failure chain ending a key
+    int depth = 0;
+  };
+  struct edge {
+    int next;
+    unsigned char label;
+  };
+
+  int transition(int s, unsigned char c) const {
+    if (!s)
+      return _root[c] ? _root[c] : -1;
+    int lo = _state[s].begin, hi = _state[s].end;
+    if (hi - lo <= 8) {
+      for (int i = lo; i < hi; ++i)
+        if (_edge[i].label == c)
+          return _edge[i].next;
+      return -1;
+    }
+    while (lo < hi) {
+      int mid = (lo + hi) >> 1;
+      if (_edge[mid].label < c)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo < _state[s].end && _edge[lo].label == c ? _edge[lo].next : -1;
+  }
+
+  int _root[256] = {0};
+  size_t _maxDepth = 0;
+  std::vector<state> _state;
+  std::vector<edge> _edge;
+  std::vector<int> _value;
+  std::vector<int> _link;   // next state on the failure chain ending a key
+};
+
+#endif
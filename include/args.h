@@ -18,13 +18,22 @@ class Args {
   public:
   std::string input;
   std::string pattern;
+  std::string save;
+  std::string stats_json;
   int num_threads = -1;
   int num_patterns = -1;
+  int huge_pages = 0;
   bool fast = false;
   bool hit = false;
   bool seg = false;
+  bool ac = false;
+  bool teddy = false;
+  bool stream = false;
+  bool stats = false;
+  bool numa = false;
   size_t N = 0;
   size_t M = 0;
+  size_t batch = 0;
 
   Args(const std::vector<std::string>& args) {
     for (int i = 1; i < args.size(); i += 2) {
@@ -42,6 +51,8 @@ class Args {
           input = std::string(args.at(i + 1));
         } else if (args[i] == "--pattern") {
           pattern = std::string(args.at(i + 1));
+        } else if (args[i] == "--save") {
+          save = std::string(args.at(i + 1));
         } else if (args[i] == "--num_threads") {
           num_threads = std::stoi(args.at(i + 1));
         } else if (args[i] == "--num_patterns") {
@@ -55,6 +66,27 @@ class Args {
         } else if (args[i] == "--seg") {
           seg = true;
           i--;
+        } else if (args[i] == "--ac") {
+          ac = true;
+          i--;
+        } else if (args[i] == "--teddy") {
+          teddy = true;
+          i--;
+        } else if (args[i] == "--stream") {
+          stream = true;
+          i--;
+        } else if (args[i] == "--stats") {
+          stats = true;
+          i--;
+        } else if (args[i] == "--stats_json") {
+          stats_json = std::string(args.at(i + 1));
+        } else if (args[i] == "--numa") {
+          numa = true;
+          i--;
+        } else if (args[i] == "--huge_pages") {
+          huge_pages = std::stoi(args.at(i + 1));
+        } else if (args[i] == "--batch") {
+          batch = static_cast<size_t>(stoul(args.at(i + 1)));
         } else if (args[i] == "--N") {
           N = static_cast<size_t>(stoul(args.at(i + 1)));
         } else if (args[i] == "--M") {
@@ -75,17 +107,31 @@ class Args {
       printHelp();
       exit(EXIT_FAILURE);
     }
+    if (huge_pages < 0 || huge_pages > 2) {
+      std::cerr << "--huge_pages must be 0, 1 or 2." << std::endl;
+      printHelp();
+      exit(EXIT_FAILURE);
+    }
   }
   
   void printHelp() {
     std::cerr << "\nLarge-scale Exact String Matching Tool! Usage:\n";
     std::cerr << "  --input         text string file path\n"
-              << "  --pattern       pattern string or pattern string file path\n"
+              << "  --pattern       pattern string, pattern string file path or index path\n"
+              << "  --save          save the pattern index to this path\n"
               << "  --num_threads   number of threads\n"
               << "  --num_patterns  number of matching patterns returned\n"
               << "  --fast          enable fast matching mode\n"
               << "  --hit           enable hit matching mode\n"
               << "  --seg           enable maximum forward matching word segmentation\n"
+              << "  --ac            scan texts with an Aho-Corasick automaton\n"
+              << "  --teddy         prefilter texts with SIMD key fingerprints\n"
+              << "  --stream        stream text strings in bounded memory\n"
+              << "  --batch         number of text strings per batch in streaming mode\n"
+              << "  --huge_pages    trie in huge pages: 1 transparent, 2 reserved (hugetlbfs)\n"
+              << "  --numa          pin threads and match against per-NUMA-node pattern copies\n"
+              << "  --stats         print stage timings and throughput to stderr\n"
+              << "  --stats_json    write stage timings and throughput as JSON to this path\n"
               << "  --N             total number of text strings\n"
               << "  --M             total number of pattern strings\n"
               << "  --help -h       show help information\n\n";
@@ -10,6 +10,7 @@
 #include <cassert>
 #include <string>
 #include <vector>
+#include <sys/mman.h>
 
 #define STATIC_ASSERT(e, msg) typedef char msg[(e) ? 1 : -1]
 
@@ -19,6 +20,7 @@ namespace cedar {
   template <typename T> struct NaN { enum { N1 = -1, N2 = -2 }; };
   template <> struct NaN <float> { enum { N1 = 0x7f800001, N2 = 0x7f800002 }; };
   static const int MAX_ALLOC_SIZE = 1 << 16; // must be divisible by 256
+  static const size_t HUGE_PAGE_SIZE = 1 << 21; // 2 MB
   // dynamic double array
   template <typename value_type,
             const int     NO_VALUE  = NaN <value_type>::N1,
@@ -64,17 +66,85 @@ namespace cedar {
       int   ehead;  // first empty item
       block () : prev (0), next (0), num (256), reject (257), trial (0), ehead (0) {}
     };
-    da () : tracking_node (), _array (0), _ninfo (0), _block (0), _bheadF (0), _bheadC (0), _bheadO (0), _capacity (0), _size (0), _no_delete (false), _reject () {
+    da () : tracking_node (), _array (0), _ninfo (0), _block (0), _bheadF (0), _bheadC (0), _bheadO (0), _capacity (0), _size (0), _no_delete (false), _pages (SMALL_PAGES), _reject () {
       STATIC_ASSERT(sizeof (value_type) <= sizeof (int),
                     value_type_is_not_supported___maintain_a_value_array_by_yourself_and_store_its_index
                     );
       _initialize ();
     }
+    da (const da& d) : _array (0), _ninfo (0), _block (0), _bheadF (d._bheadF), _bheadC (d._bheadC), _bheadO (d._bheadO), _capacity (d._capacity), _size (d._size), _no_delete (false), _pages (d._pages) { // deep copy
+      const int n = d._capacity > d._size ? d._capacity : d._size; // an array from set_array () has no capacity
+      _copy_array (_array, d._array, n);
+      if (d._ninfo) _copy_array (_ninfo, d._ninfo, n);
+      if (d._block) _copy_array (_block, d._block, n >> 8);
+      for (size_t i = 0 ; i <= NUM_TRACKING_NODES; ++i) tracking_node[i] = d.tracking_node[i];
+      for (short  i = 0; i <= 256; ++i) _reject[i] = d._reject[i];
+    }
     ~da () { clear (false); }
     size_t capacity   () const { return static_cast <size_t> (_capacity); }
     size_t size       () const { return static_cast <size_t> (_size); }
     size_t total_size () const { return sizeof (node) * _size; }
     size_t unit_size  () const { return sizeof (node); }
+    // bytes allocated (or set) for nodes, ninfo and blocks; ninfo and blocks are only used to update
+    size_t array_size () const { return sizeof (node) * _allocated (); }
+    size_t ninfo_size () const { return _ninfo ? sizeof (ninfo) * _allocated () : 0; }
+    size_t block_size () const { return _block ? sizeof (block) * (_allocated () >> 8) : 0; }
+    // Where the arrays live: malloc'ed memory (SMALL_PAGES), or anonymous
+    // mappings aligned to 2 MB and backed by transparent huge pages
+    // (HUGE_PAGES) or by the huge pages reserved in /proc/sys/vm/nr_hugepages
+    // (HUGETLB_PAGES, transparent ones when the reserve is used up), so that
+    // a large trie takes few TLB entries. Arrays below 2 MB are malloc'ed.
+    enum page_type { SMALL_PAGES, HUGE_PAGES, HUGETLB_PAGES };
+    // resize an array of realloc_pages () (or allocate one for p = 0) to
+    // bytes, in pages; it moves if it lives in other pages. 0 on failure,
+    // and p is kept
+    static void* realloc_pages (void* p, const size_t bytes, const page_type pages) {
+      chunk* c = p ? static_cast <chunk*> (p) - 1 : 0;
+      const size_t need = sizeof (chunk) + bytes;
+      const page_type want = need < HUGE_PAGE_SIZE ? SMALL_PAGES : pages;
+      if (want == SMALL_PAGES && (! c || c->pages == SMALL_PAGES)) {
+        if (! (c = static_cast <chunk*> (std::realloc (c, need)))) return 0;
+        c->bytes = bytes, c->mapped = 0, c->pages = SMALL_PAGES;
+        return c + 1;
+      }
+      if (c && c->pages != SMALL_PAGES && (c->pages == want || want == HUGETLB_PAGES) && need <= c->mapped) {
+        const size_t mapped = _round_pages (need);
+        if (mapped < c->mapped) // trim in place
+          ::munmap (reinterpret_cast <char*> (c) + mapped, c->mapped - mapped), c->mapped = mapped;
+        c->bytes = bytes;
+        return p;
+      }
+      chunk* d = want == SMALL_PAGES ? static_cast <chunk*> (std::malloc (need)) : _map_pages (need, want);
+      if (! d) return 0;
+      d->bytes = bytes;
+      if (want == SMALL_PAGES) d->mapped = 0, d->pages = SMALL_PAGES;
+      if (c) std::memcpy (d + 1, p, c->bytes < bytes ? c->bytes : bytes), free_pages (p);
+      return d + 1;
+    }
+    static void free_pages (void* p) {
+      if (! p) return;
+      chunk* c = static_cast <chunk*> (p) - 1;
+      if (c->mapped) ::munmap (c, c->mapped);
+      else std::free (c);
+    }
+    page_type pages () const { return _pages; }
+    // allocate the arrays in pages from now on and move them there; an
+    // array set by set_array () is copied unless pages is SMALL_PAGES
+    void set_pages (const page_type pages) {
+      _pages = pages;
+      if (_no_delete) {
+        if (pages != SMALL_PAGES) copy_array ();
+        return;
+      }
+      _repage (_array);
+      _repage (_ninfo);
+      _repage (_block);
+    }
+    // bytes of the arrays that live in huge page mappings
+    size_t huge_size () const {
+      if (_no_delete) return 0;
+      return _huge_size (_array) + _huge_size (_ninfo) + _huge_size (_block);
+    }
     size_t nonzero_size () const {
       size_t i = 0;
       for (int to = 0; to < _size; ++to)
@@ -218,6 +288,9 @@ namespace cedar {
     }
     void erase (size_t from) {
       // _test ();
+#ifndef USE_FAST_LOAD
+      if (! _ninfo || ! _block) restore ();
+#endif
 #ifdef USE_REDUCED_TRIE
       int e = _array[from].value >= 0 ? static_cast <int> (from) : _array[from].base () ^ 0;
       from = static_cast <size_t> (_array[e].check);
@@ -290,10 +363,10 @@ namespace cedar {
       clear (false);
       size_ = (size_ - offset) / sizeof (node);
       if (std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0) return -1;
-      _array = static_cast <node*>  (std::malloc (sizeof (node)  * size_));
+      _array = static_cast <node*>  (realloc_pages (0, sizeof (node)  * size_, _pages));
 #ifdef USE_FAST_LOAD
-      _ninfo = static_cast <ninfo*> (std::malloc (sizeof (ninfo) * size_));
-      _block = static_cast <block*> (std::malloc (sizeof (block) * size_));
+      _ninfo = static_cast <ninfo*> (realloc_pages (0, sizeof (ninfo) * size_, _pages));
+      _block = static_cast <block*> (realloc_pages (0, sizeof (block) * size_, _pages));
       if (! _array || ! _ninfo || ! _block)
 #else
         if (! _array)
@@ -325,6 +398,13 @@ namespace cedar {
       if (! _ninfo) _restore_ninfo ();
       _capacity = _size;
     }
+    void adopt_array (node* p, size_t size_, ninfo* q = 0) { // take over arrays of realloc_pages () built elsewhere
+      clear (false);
+      _array = p;
+      _ninfo = q;
+      _size  = static_cast <int> (size_);
+      restore ();
+    }
 #endif
     void set_array (void* p, size_t size_ = 0) { // ad-hoc
       clear (false);
@@ -333,10 +413,31 @@ namespace cedar {
       _no_delete = true;
     }
     const void* array () const { return _array; }
+#ifndef USE_FAST_LOAD
+    void shrink_to_fit (const bool drop = false) { // trim capacity; drop ninfo and blocks until the next update
+      if (drop) {
+        free_pages (_ninfo); _ninfo = 0;
+        free_pages (_block); _block = 0;
+      }
+      if (_no_delete || _capacity <= _size) return;
+      _realloc_array (_array, _size, _size);
+      if (_ninfo) _realloc_array (_ninfo, _size, _size);
+      if (_block) _realloc_array (_block, _size >> 8, _size >> 8);
+      _capacity = _size;
+    }
+#endif
+    void copy_array () { // take a private copy of an array set by set_array ()
+      if (! _no_delete) return;
+      node* p = static_cast <node*> (realloc_pages (0, sizeof (node) * static_cast <size_t> (_size), _pages));
+      if (! p) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      std::memcpy (p, _array, sizeof (node) * static_cast <size_t> (_size));
+      _array = p;
+      _no_delete = false;
+    }
     void clear (const bool reuse = true) {
-      if (_array && ! _no_delete) std::free (_array); _array = 0;
-      if (_ninfo) std::free (_ninfo); _ninfo = 0;
-      if (_block) std::free (_block); _block = 0;
+      if (_array && ! _no_delete) free_pages (_array); _array = 0;
+      if (_ninfo) free_pages (_ninfo); _ninfo = 0;
+      if (_block) free_pages (_block); _block = 0;
       _bheadF = _bheadC = _bheadO = _capacity = _size = 0; // *
       if (reuse) _initialize ();
       _no_delete = false;
@@ -386,8 +487,7 @@ namespace cedar {
     }
     size_t tracking_node[NUM_TRACKING_NODES + 1];
   private:
-    // currently disabled; implement these if you need
-    da (const da&);
+    // currently disabled; implement this if you need
     da& operator= (const da&);
     node*   _array;
     ninfo*  _ninfo;
@@ -398,15 +498,71 @@ namespace cedar {
     int     _capacity;
     int     _size;
     int     _no_delete;
+    page_type _pages;
     short   _reject[257];
     //
+    size_t _allocated () const { return static_cast <size_t> (_capacity > _size ? _capacity : _size); }
     static void _err (const char* fn, const int ln, const char* msg)
     { std::fprintf (stderr, "cedar: %s [%d]: %s", fn, ln, msg); std::exit (1); }
+    struct chunk { // header of an array of realloc_pages ()
+      size_t    bytes;
+      size_t    mapped; // bytes mapped from the header; 0 if malloc'ed
+      page_type pages;
+    };
+    static size_t _round_pages (const size_t n) { return (n + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1); }
+    // map need bytes, rounded up to 2 MB, in huge pages of type pages
+    static chunk* _map_pages (const size_t need, const page_type pages) {
+      const size_t mapped = _round_pages (need);
+      chunk* c = 0;
+#if defined (MAP_HUGETLB) && defined (MAP_HUGE_SHIFT)
+      if (pages == HUGETLB_PAGES) {
+        void* p = ::mmap (0, mapped, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+        if (p != MAP_FAILED) {
+          c = static_cast <chunk*> (p);
+          c->mapped = mapped, c->pages = HUGETLB_PAGES;
+          return c;
+        }
+      }
+#endif
+      // over-map by 2 MB and cut the mapping down to an aligned one
+      void* p = ::mmap (0, mapped + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) return 0;
+      char* const b = static_cast <char*> (p);
+      char* const q = reinterpret_cast <char*> (_round_pages (reinterpret_cast <size_t> (b)));
+      if (q != b) ::munmap (b, static_cast <size_t> (q - b));
+      ::munmap (q + mapped, static_cast <size_t> (b + HUGE_PAGE_SIZE - q));
+#ifdef MADV_HUGEPAGE
+      ::madvise (q, mapped, MADV_HUGEPAGE);
+#endif
+      c = reinterpret_cast <chunk*> (q);
+      c->mapped = mapped, c->pages = HUGE_PAGES;
+      return c;
+    }
+    template <typename T>
+    void _repage (T*& p) {
+      if (! p) return;
+      void* tmp = realloc_pages (p, (reinterpret_cast <chunk*> (p) - 1)->bytes, _pages);
+      if (! tmp) _err (__FILE__, __LINE__, "memory reallocation failed\n");
+      p = static_cast <T*> (tmp);
+    }
+    template <typename T>
+    static size_t _huge_size (const T* p) {
+      const chunk* c = p ? reinterpret_cast <const chunk*> (p) - 1 : 0;
+      return c && c->pages != SMALL_PAGES ? c->mapped : 0;
+    }
+    template <typename T>
+    void _copy_array (T*& p, const T* src, const int size) {
+      p = static_cast <T*> (realloc_pages (0, sizeof (T) * static_cast <size_t> (size), _pages));
+      if (! p) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      std::memcpy (p, src, sizeof (T) * static_cast <size_t> (size));
+    }
     template <typename T>
-    static void _realloc_array (T*& p, const int size_n, const int size_p = 0) {
-      void* tmp = std::realloc (p, sizeof (T) * static_cast <size_t> (size_n));
+    void _realloc_array (T*& p, const int size_n, const int size_p = 0) {
+      void* tmp = realloc_pages (p, sizeof (T) * static_cast <size_t> (size_n), _pages);
       if (! tmp)
-        std::free (p), _err (__FILE__, __LINE__, "memory reallocation failed\n");
+        free_pages (p), _err (__FILE__, __LINE__, "memory reallocation failed\n");
       p = static_cast <T*> (tmp);
       static const T T0 = T ();
       for (T* q (p + size_p), * const r (p + size_n); q != r; ++q) *q = T0;
@@ -478,7 +634,7 @@ namespace cedar {
         block& b = _block[bi];
         b.num = 0;
         for (; e < (bi << 8) + 256; ++e)
-          if (_array[e].check < 0 && ++b.num == 1) b.ehead = e;
+          if (e && _array[e].check < 0 && ++b.num == 1) b.ehead = e; // the root (check -1) is not empty
         int& head_out = b.num == 1 ? _bheadC : (b.num == 0 ? _bheadF : _bheadO);
         _push_block (bi, head_out, ! head_out && b.num);
       }
@@ -1,6 +1,14 @@
 // cedar -- C++ implementation of Efficiently-updatable Double ARray trie
-//  $Id: cedar.h 1814 2014-05-07 03:42:04Z ynaga $
+//  $Id: cedarpp.h 1814 2014-05-07 03:42:04Z ynaga $
 // Copyright (c) 2009-2014 Naoki Yoshinaga <ynaga@tkl.iis.u-tokyo.ac.jp>
+//
+// Minimal-prefix variant: only the bytes up to where a key is distinguished
+// from all others are nodes; the rest of the key and its value are kept in
+// a tail buffer. A node with a negative base_ is such a leaf, and -base_ is
+// the offset of its suffix in the tail: the suffix bytes, '\0', padding to
+// sizeof (int) and the value. Keys must not contain '\0'. A position inside
+// a tail is passed in from as the node with the tail offset in the upper 32
+// bits. USE_REDUCED_TRIE and USE_FAST_LOAD are not supported.
 #ifndef CEDAR_H
 #define CEDAR_H
 
@@ -10,6 +18,7 @@
 #include <cassert>
 #include <string>
 #include <vector>
+#include <sys/mman.h>
 
 #define STATIC_ASSERT(e, msg) typedef char msg[(e) ? 1 : -1]
 
@@ -19,6 +28,7 @@ namespace cedar {
   template <typename T> struct NaN { enum { N1 = -1, N2 = -2 }; };
   template <> struct NaN <float> { enum { N1 = 0x7f800001, N2 = 0x7f800002 }; };
   static const int MAX_ALLOC_SIZE = 1 << 16; // must be divisible by 256
+  static const size_t HUGE_PAGE_SIZE = 1 << 21; // 2 MB
   // dynamic double array
   template <typename value_type,
             const int     NO_VALUE  = NaN <value_type>::N1,
@@ -28,6 +38,7 @@ namespace cedar {
             const size_t  NUM_TRACKING_NODES = 0>
   class da {
   public:
+    static_assert (sizeof (size_t) >= 8, "tail positions need a 64-bit size_t");
     enum error_code { CEDAR_NO_VALUE = NO_VALUE, CEDAR_NO_PATH = NO_PATH, CEDAR_VALUE_LIMIT = 2147483647 };
     typedef value_type result_type;
     struct result_pair_type {
@@ -40,15 +51,11 @@ namespace cedar {
       size_t      id;      // node id of value
     };
     struct node {
-      union { int base_; value_type value; }; // negative means prev empty index
+      union { int base_; value_type value; }; // negative means prev empty index or tail offset
       int  check;                             // negative means next empty index
       node (const int base__ = 0, const int check_ = 0)
         : base_ (base__), check (check_) {}
-#ifdef USE_REDUCED_TRIE
-      int base () const { return - (base_ + 1); } // ~ in two's complement system
-#else
       int base () const { return base_; }
-#endif
     };
     struct ninfo {  // x1.5 update speed; +.25 % memory (8n -> 10n)
       uchar  sibling;   // right sibling (= 0 if not exist)
@@ -64,31 +71,102 @@ namespace cedar {
       int   ehead;  // first empty item
       block () : prev (0), next (0), num (256), reject (257), trial (0), ehead (0) {}
     };
-    da () : tracking_node (), _array (0), _ninfo (0), _block (0), _bheadF (0), _bheadC (0), _bheadO (0), _capacity (0), _size (0), _no_delete (false), _reject () {
+    da () : tracking_node (), _array (0), _tail (0), _ninfo (0), _block (0), _bheadF (0), _bheadC (0), _bheadO (0), _capacity (0), _size (0), _tail_capacity (0), _tail_size (0), _no_delete (false), _pages (SMALL_PAGES), _reject () {
       STATIC_ASSERT(sizeof (value_type) <= sizeof (int),
                     value_type_is_not_supported___maintain_a_value_array_by_yourself_and_store_its_index
                     );
       _initialize ();
     }
+    da (const da& d) : _array (0), _tail (0), _ninfo (0), _block (0), _bheadF (d._bheadF), _bheadC (d._bheadC), _bheadO (d._bheadO), _capacity (d._capacity), _size (d._size), _tail_capacity (d._tail_size), _tail_size (d._tail_size), _no_delete (false), _pages (d._pages) { // deep copy
+      const int n = d._capacity > d._size ? d._capacity : d._size; // an array from set_array () has no capacity
+      _copy_array (_array, d._array, n);
+      _copy_array (_tail, d._tail, d._tail_size);
+      if (d._ninfo) _copy_array (_ninfo, d._ninfo, n);
+      if (d._block) _copy_array (_block, d._block, n >> 8);
+      for (size_t i = 0 ; i <= NUM_TRACKING_NODES; ++i) tracking_node[i] = d.tracking_node[i];
+      for (short  i = 0; i <= 256; ++i) _reject[i] = d._reject[i];
+    }
     ~da () { clear (false); }
     size_t capacity   () const { return static_cast <size_t> (_capacity); }
     size_t size       () const { return static_cast <size_t> (_size); }
-    size_t total_size () const { return sizeof (node) * _size; }
+    size_t total_size () const { return sizeof (node) * _size; } // nodes only; see tail_size ()
     size_t unit_size  () const { return sizeof (node); }
+    // bytes allocated (or set) for nodes, ninfo and blocks; ninfo and blocks are only used to update
+    size_t array_size () const { return sizeof (node) * _allocated (); }
+    size_t ninfo_size () const { return _ninfo ? sizeof (ninfo) * _allocated () : 0; }
+    size_t block_size () const { return _block ? sizeof (block) * (_allocated () >> 8) : 0; }
+    // Where the arrays live: malloc'ed memory (SMALL_PAGES), or anonymous
+    // mappings aligned to 2 MB and backed by transparent huge pages
+    // (HUGE_PAGES) or by the huge pages reserved in /proc/sys/vm/nr_hugepages
+    // (HUGETLB_PAGES, transparent ones when the reserve is used up), so that
+    // a large trie takes few TLB entries. Arrays below 2 MB are malloc'ed.
+    enum page_type { SMALL_PAGES, HUGE_PAGES, HUGETLB_PAGES };
+    // resize an array of realloc_pages () (or allocate one for p = 0) to
+    // bytes, in pages; it moves if it lives in other pages. 0 on failure,
+    // and p is kept
+    static void* realloc_pages (void* p, const size_t bytes, const page_type pages) {
+      chunk* c = p ? static_cast <chunk*> (p) - 1 : 0;
+      const size_t need = sizeof (chunk) + bytes;
+      const page_type want = need < HUGE_PAGE_SIZE ? SMALL_PAGES : pages;
+      if (want == SMALL_PAGES && (! c || c->pages == SMALL_PAGES)) {
+        if (! (c = static_cast <chunk*> (std::realloc (c, need)))) return 0;
+        c->bytes = bytes, c->mapped = 0, c->pages = SMALL_PAGES;
+        return c + 1;
+      }
+      if (c && c->pages != SMALL_PAGES && (c->pages == want || want == HUGETLB_PAGES) && need <= c->mapped) {
+        const size_t mapped = _round_pages (need);
+        if (mapped < c->mapped) // trim in place
+          ::munmap (reinterpret_cast <char*> (c) + mapped, c->mapped - mapped), c->mapped = mapped;
+        c->bytes = bytes;
+        return p;
+      }
+      chunk* d = want == SMALL_PAGES ? static_cast <chunk*> (std::malloc (need)) : _map_pages (need, want);
+      if (! d) return 0;
+      d->bytes = bytes;
+      if (want == SMALL_PAGES) d->mapped = 0, d->pages = SMALL_PAGES;
+      if (c) std::memcpy (d + 1, p, c->bytes < bytes ? c->bytes : bytes), free_pages (p);
+      return d + 1;
+    }
+    static void free_pages (void* p) {
+      if (! p) return;
+      chunk* c = static_cast <chunk*> (p) - 1;
+      if (c->mapped) ::munmap (c, c->mapped);
+      else std::free (c);
+    }
+    page_type pages () const { return _pages; }
+    // allocate the arrays in pages from now on and move them there; an
+    // array set by set_array () is copied unless pages is SMALL_PAGES
+    void set_pages (const page_type pages) {
+      _pages = pages;
+      if (_no_delete) {
+        if (pages != SMALL_PAGES) copy_array ();
+        return;
+      }
+      _repage (_array);
+      _repage (_ninfo);
+      _repage (_block);
+      _repage (_tail);
+    }
+    // bytes of the arrays that live in huge page mappings
+    size_t huge_size () const {
+      if (_no_delete) return 0;
+      return _huge_size (_array) + _huge_size (_ninfo) + _huge_size (_block) + _huge_size (_tail);
+    }
+    // the tail; bytes used and allocated (or set)
+    const void* tail () const { return _tail; }
+    size_t tail_size () const { return static_cast <size_t> (_tail_size); }
+    size_t tail_capacity () const { return static_cast <size_t> (_tail_capacity > _tail_size ? _tail_capacity : _tail_size); }
     size_t nonzero_size () const {
       size_t i = 0;
       for (int to = 0; to < _size; ++to)
         if (_array[to].check >= 0) ++i;
       return i;
     }
-    size_t num_keys () const {
+    size_t num_keys () const { // value nodes and tail leaves
       size_t i = 0;
       for (int to = 0; to < _size; ++to)
-#ifdef USE_REDUCED_TRIE
-        if (_array[to].check >= 0 && _array[to].value >= 0) ++i;
-#else
-        if (_array[to].check >= 0 && _array[_array[to].check].base () == to) ++i;
-#endif
+        if (_array[to].check >= 0 &&
+            (_array[_array[to].check].base () == to || _array[to].base_ < 0)) ++i;
       return i;
     }
     // interfance
@@ -122,7 +200,7 @@ namespace cedar {
       for (size_t pos = 0; pos < len; ) {
         if (num == result_len)  return num;
         union { int i; value_type x; } b;
-        b.i = _find (key, from, pos, pos + 1);
+        b.i = _find_prefix (key, from, pos, len);
         if (b.i == CEDAR_NO_VALUE) continue;
         if (b.i == CEDAR_NO_PATH)  return num;
         _set_result (&result[num], b.x, pos, from);
@@ -136,10 +214,10 @@ namespace cedar {
       for (size_t pos = 0; pos < len; ) {
         if (num == result_len)  return num;
         union { int i; value_type x; } b;
-        b.i = _find (key, from, pos, pos + 1);
+        b.i = _find_prefix (key, from, pos, len);
         if (b.i == CEDAR_NO_VALUE) continue;
         if (b.i == CEDAR_NO_PATH)  return num;
-        _set_result (result, b.x, pos, from); 
+        _set_result (result, b.x, pos, from);
         ++num;
       }
       return num;
@@ -160,15 +238,6 @@ namespace cedar {
       }
       return num;
     }
-    void suffix (char* key, size_t len, size_t to) const {
-      key[len] = '\0';
-      while (len--) {
-        const int from = _array[to].check;
-        key[len]
-          = static_cast <char> (_array[from].base () ^ static_cast <int> (to));
-        to = static_cast <size_t> (from);
-      }
-    }
     value_type traverse (const char* key, size_t& from, size_t& pos) const
     { return traverse (key, from, pos, std::strlen (key)); }
     value_type traverse (const char* key, size_t& from, size_t& pos, size_t len) const {
@@ -183,31 +252,33 @@ namespace cedar {
     { size_t from (0), pos (0); return update (key, from, pos, len, val); }
     value_type& update (const char* key, size_t& from, size_t& pos, size_t len, value_type val = value_type (0))
     { empty_callback cf; return update (key, from, pos, len, val, cf); }
+    // from may be a tail position reached by key[0, pos)
     template <typename T>
     value_type& update (const char* key, size_t& from, size_t& pos, size_t len, value_type val, T& cf) {
       if (! len && ! from)
         _err (__FILE__, __LINE__, "failed to insert zero-length key\n");
-#ifndef USE_FAST_LOAD
       if (! _ninfo || ! _block) restore ();
-#endif
+      if (const size_t offset = from >> 32) { // back to the start of the tail
+        from &= TAIL_MASK;
+        pos -= offset - static_cast <size_t> (- _array[from].base_);
+      }
       for (const uchar* const key_ = reinterpret_cast <const uchar*> (key);
-           pos < len; ++pos) {
-#ifdef USE_REDUCED_TRIE
-        const value_type val_ = _array[from].value;
-        if (val_ >= 0 && val_ != CEDAR_VALUE_LIMIT) // always new; correct this!
-          { const int to = _follow (from, 0, cf); _array[to].value = val_; }
-#endif
-        from = static_cast <size_t> (_follow (from, key_[pos], cf));
+           pos < len && _array[from].base_ >= 0; ++pos) {
+        const int to = _array[from].base_ ^ key_[pos];
+        if (_array[to].check != static_cast <int> (from)) { // new leaf for the rest of key
+          from = static_cast <size_t> (_follow (from, key_[pos], cf));
+          ++pos;
+          return _push_tail (from, pos, key, len, val);
+        }
+        from = static_cast <size_t> (to);
       }
-#ifdef USE_REDUCED_TRIE
-      const int to = _array[from].value >= 0 ? static_cast <int> (from) : _follow (from, 0, cf);
-      if (_array[to].value == CEDAR_VALUE_LIMIT) _array[to].value = 0;
-#else
-      const int to = _follow (from, 0, cf);
-#endif
-      return _array[to].value += val;
+      if (_array[from].base_ >= 0) {
+        const int to = _follow (from, 0, cf);
+        return _array[to].value += val;
+      }
+      return _split (from, pos, key, len, val, cf);
     }
-    // easy-going erase () without compression
+    // easy-going erase () without compression; the tail is not reclaimed
     int erase (const char* key) { return erase (key, std::strlen (key)); }
     int erase (const char* key, size_t len, size_t from = 0) {
       size_t pos = 0;
@@ -216,14 +287,15 @@ namespace cedar {
       erase (from);
       return 0;
     }
-    void erase (size_t from) {
+    void erase (size_t from) { // from: where a key ends, as left by _find ()
       // _test ();
-#ifdef USE_REDUCED_TRIE
-      int e = _array[from].value >= 0 ? static_cast <int> (from) : _array[from].base () ^ 0;
-      from = static_cast <size_t> (_array[e].check);
-#else
-      int e = _array[from].base () ^ 0;
-#endif
+      if (! _ninfo || ! _block) restore ();
+      int e = 0;
+      if ((from >> 32) || _array[from].base_ < 0) { // a leaf
+        e = static_cast <int> (from & TAIL_MASK);
+        from = static_cast <size_t> (_array[e].check);
+      } else
+        e = _array[from].base () ^ 0;
       bool flag = false; // have sibling
       do {
         const node& n = _array[from];
@@ -254,25 +326,15 @@ namespace cedar {
         else
           _err (__FILE__, __LINE__, "dump() needs array of length = num_keys()\n");
     }
+    // the tail size, the tail and the nodes
     int save (const char* fn, const char* mode = "wb") const {
       // _test ();
       FILE* fp = std::fopen (fn, mode);
       if (! fp) return -1;
+      std::fwrite (&_tail_size, sizeof (int), 1, fp);
+      std::fwrite (_tail, sizeof (char), static_cast <size_t> (_tail_size), fp);
       std::fwrite (_array, sizeof (node), static_cast <size_t> (_size), fp);
       std::fclose (fp);
-#ifdef USE_FAST_LOAD
-      const char* const info
-        = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
-      fp = std::fopen (info, mode);
-      delete [] info; // resolve memory leak
-      if (! fp) return -1;
-      std::fwrite (&_bheadF, sizeof (int), 1, fp);
-      std::fwrite (&_bheadC, sizeof (int), 1, fp);
-      std::fwrite (&_bheadO, sizeof (int), 1, fp);
-      std::fwrite (_ninfo, sizeof (ninfo), static_cast <size_t> (_size), fp);
-      std::fwrite (_block, sizeof (block), static_cast <size_t> (_size >> 8), fp);
-      std::fclose (fp);
-#endif
       return 0;
     }
     int open (const char* fn, const char* mode = "rb",
@@ -285,88 +347,106 @@ namespace cedar {
         size_ = static_cast <size_t> (std::ftell (fp));
         if (std::fseek (fp, 0, SEEK_SET) != 0) return -1;
       }
-      if (size_ <= offset) return -1;
-      // set array
+      if (size_ <= offset + sizeof (int)) return -1;
+      // set tail and array
       clear (false);
-      size_ = (size_ - offset) / sizeof (node);
       if (std::fseek (fp, static_cast <long> (offset), SEEK_SET) != 0) return -1;
-      _array = static_cast <node*>  (std::malloc (sizeof (node)  * size_));
-#ifdef USE_FAST_LOAD
-      _ninfo = static_cast <ninfo*> (std::malloc (sizeof (ninfo) * size_));
-      _block = static_cast <block*> (std::malloc (sizeof (block) * size_));
-      if (! _array || ! _ninfo || ! _block)
-#else
-        if (! _array)
-#endif
-          _err (__FILE__, __LINE__, "memory allocation failed\n");
-      if (size_ != std::fread (_array, sizeof (node), size_, fp)) return -1;
+      int length = 0;
+      if (std::fread (&length, sizeof (int), 1, fp) != 1 || length < static_cast <int> (sizeof (int)) ||
+          size_ < offset + sizeof (int) + static_cast <size_t> (length)) return -1;
+      size_ = (size_ - offset - sizeof (int) - static_cast <size_t> (length)) / sizeof (node);
+      _tail  = static_cast <char*> (realloc_pages (0, static_cast <size_t> (length), _pages));
+      _array = static_cast <node*> (realloc_pages (0, sizeof (node)  * size_, _pages));
+      if (! _tail || ! _array)
+        _err (__FILE__, __LINE__, "memory allocation failed\n");
+      if (static_cast <size_t> (length) != std::fread (_tail, sizeof (char), static_cast <size_t> (length), fp) ||
+          size_ != std::fread (_array, sizeof (node), size_, fp)) return -1;
       std::fclose (fp);
       _size = static_cast <int> (size_);
-#ifdef USE_FAST_LOAD
-      const char* const info
-        = std::strcat (std::strcpy (new char[std::strlen (fn) + 5], fn), ".sbl");
-      fp = std::fopen (info, mode);
-      delete [] info; // resolve memory leak
-      if (! fp) return -1;
-      std::fread (&_bheadF, sizeof (int), 1, fp);
-      std::fread (&_bheadC, sizeof (int), 1, fp);
-      std::fread (&_bheadO, sizeof (int), 1, fp);
-      if (size_ != std::fread (_ninfo, sizeof (ninfo), size_, fp) ||
-          size_ != std::fread (_block, sizeof (block), size_ >> 8, fp) << 8)
-        return -1;
-      std::fclose (fp);
-      _capacity = _size;
-#endif
+      _tail_size = _tail_capacity = length;
       return 0;
     }
-#ifndef USE_FAST_LOAD
     void restore () { // restore information to update
       if (! _block) _restore_block ();
       if (! _ninfo) _restore_ninfo ();
       _capacity = _size;
     }
-#endif
-    void set_array (void* p, size_t size_ = 0) { // ad-hoc
+    void adopt_array (node* p, size_t size_, ninfo* q = 0) { // take over arrays of realloc_pages () built elsewhere; no tail
+      clear (false);
+      _array = p;
+      _ninfo = q;
+      _size  = static_cast <int> (size_);
+      _reset_tail ();
+      restore ();
+    }
+    void set_array (void* p, size_t size_ = 0, const void* tail = 0, size_t tail_size_ = 0) { // ad-hoc
       clear (false);
       _array = static_cast <node*> (p);
       _size  = static_cast <int> (size_);
+      if (tail) {
+        _tail = static_cast <char*> (const_cast <void*> (tail));
+        _tail_size = static_cast <int> (tail_size_);
+      } else // an array without leaves
+        _tail = const_cast <char*> (_empty_tail ()), _tail_size = sizeof (int);
       _no_delete = true;
     }
     const void* array () const { return _array; }
+    void shrink_to_fit (const bool drop = false) { // trim capacity; drop ninfo and blocks until the next update
+      if (drop) {
+        free_pages (_ninfo); _ninfo = 0;
+        free_pages (_block); _block = 0;
+      }
+      if (_no_delete) return;
+      if (_tail_capacity > _tail_size) {
+        _realloc_array (_tail, _tail_size, _tail_size);
+        _tail_capacity = _tail_size;
+      }
+      if (_capacity <= _size) return;
+      _realloc_array (_array, _size, _size);
+      if (_ninfo) _realloc_array (_ninfo, _size, _size);
+      if (_block) _realloc_array (_block, _size >> 8, _size >> 8);
+      _capacity = _size;
+    }
+    void copy_array () { // take a private copy of arrays set by set_array ()
+      if (! _no_delete) return;
+      _copy_array (_array, _array, _size);
+      _copy_array (_tail, _tail, _tail_size);
+      _tail_capacity = _tail_size;
+      _no_delete = false;
+    }
     void clear (const bool reuse = true) {
-      if (_array && ! _no_delete) std::free (_array); _array = 0;
-      if (_ninfo) std::free (_ninfo); _ninfo = 0;
-      if (_block) std::free (_block); _block = 0;
-      _bheadF = _bheadC = _bheadO = _capacity = _size = 0; // *
-      if (reuse) _initialize ();
+      if (_array && ! _no_delete) free_pages (_array); _array = 0;
+      if (_tail  && ! _no_delete) { free_pages (_tail); } _tail  = 0;
+      if (_ninfo) free_pages (_ninfo); _ninfo = 0;
+      if (_block) free_pages (_block); _block = 0;
+      _bheadF = _bheadC = _bheadO = _capacity = _size = _tail_capacity = _tail_size = 0; // *
       _no_delete = false;
+      if (reuse) _initialize ();
     }
     // return the first child for a tree rooted by a given node
     int begin (size_t& from, size_t& len) {
-#ifndef USE_FAST_LOAD
       if (! _ninfo) _restore_ninfo ();
-#endif
+      if ((from >> 32) || _array[from].base_ < 0) return _leaf (from, len);
       int   base = _array[from].base ();
       uchar c    = _ninfo[from].child;
       if (! from && ! (c = _ninfo[base ^ c].sibling)) // bug fix
         return CEDAR_NO_PATH; // no entry
       for (; c; ++len) {
         from = static_cast <size_t> (_array[from].base ()) ^ c;
+        if (_array[from].base_ < 0) return ++len, _leaf (from, len);
         c    = _ninfo[from].child;
       }
-#ifdef USE_REDUCED_TRIE
-      if (_array[from].value >= 0) return _array[from].value;
-#endif
       return _array[_array[from].base () ^ c].base_;
     }
     // return the next child if any
     int next (size_t& from, size_t& len, const size_t root = 0) {
       uchar c = 0;
-#ifdef USE_REDUCED_TRIE
-      if (_array[from].value < 0)
-#endif
+      if (from >> 32) { // back from the suffix of a leaf
+        len -= std::strlen (_tail + (from >> 32));
+        from &= TAIL_MASK;
+      } else
         c = _ninfo[_array[from].base () ^ 0].sibling;
-      for (; ! c && from != root; --len) {
+      for (; ! c && from != (root & TAIL_MASK); --len) {
         c = _ninfo[from].sibling;
         from = static_cast <size_t> (_array[from].check);
       }
@@ -374,22 +454,13 @@ namespace cedar {
         begin (from = static_cast <size_t> (_array[from].base ()) ^ c, ++len) :
         CEDAR_NO_PATH;
     }
-    // test the validity of double array for debug
-    void test (const size_t from = 0) const {
-      const int base = _array[from].base ();
-      uchar c = _ninfo[from].child;
-      do {
-        if (from) assert (_array[base ^ c].check == static_cast <int> (from));
-        if (c  && _array[base ^ c].value < 0) // correct this
-          test (static_cast <size_t> (base ^ c));
-      } while ((c = _ninfo[base ^ c].sibling));
-    }
     size_t tracking_node[NUM_TRACKING_NODES + 1];
   private:
-    // currently disabled; implement these if you need
-    da (const da&);
+    static const size_t TAIL_MASK = 0xffffffff;
+    // currently disabled; implement this if you need
     da& operator= (const da&);
     node*   _array;
+    char*   _tail;
     ninfo*  _ninfo;
     block*  _block;
     int     _bheadF;  // first block of Full;   0
@@ -397,29 +468,91 @@ namespace cedar {
     int     _bheadO;  // first block of Open;   0 if no Open
     int     _capacity;
     int     _size;
+    int     _tail_capacity;
+    int     _tail_size;
     int     _no_delete;
+    page_type _pages;
     short   _reject[257];
     //
+    size_t _allocated () const { return static_cast <size_t> (_capacity > _size ? _capacity : _size); }
     static void _err (const char* fn, const int ln, const char* msg)
     { std::fprintf (stderr, "cedar: %s [%d]: %s", fn, ln, msg); std::exit (1); }
+    struct chunk { // header of an array of realloc_pages ()
+      size_t    bytes;
+      size_t    mapped; // bytes mapped from the header; 0 if malloc'ed
+      page_type pages;
+    };
+    static size_t _round_pages (const size_t n) { return (n + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1); }
+    // map need bytes, rounded up to 2 MB, in huge pages of type pages
+    static chunk* _map_pages (const size_t need, const page_type pages) {
+      const size_t mapped = _round_pages (need);
+      chunk* c = 0;
+#if defined (MAP_HUGETLB) && defined (MAP_HUGE_SHIFT)
+      if (pages == HUGETLB_PAGES) {
+        void* p = ::mmap (0, mapped, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+        if (p != MAP_FAILED) {
+          c = static_cast <chunk*> (p);
+          c->mapped = mapped, c->pages = HUGETLB_PAGES;
+          return c;
+        }
+      }
+#endif
+      // over-map by 2 MB and cut the mapping down to an aligned one
+      void* p = ::mmap (0, mapped + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) return 0;
+      char* const b = static_cast <char*> (p);
+      char* const q = reinterpret_cast <char*> (_round_pages (reinterpret_cast <size_t> (b)));
+      if (q != b) ::munmap (b, static_cast <size_t> (q - b));
+      ::munmap (q + mapped, static_cast <size_t> (b + HUGE_PAGE_SIZE - q));
+#ifdef MADV_HUGEPAGE
+      ::madvise (q, mapped, MADV_HUGEPAGE);
+#endif
+      c = reinterpret_cast <chunk*> (q);
+      c->mapped = mapped, c->pages = HUGE_PAGES;
+      return c;
+    }
     template <typename T>
-    static void _realloc_array (T*& p, const int size_n, const int size_p = 0) {
-      void* tmp = std::realloc (p, sizeof (T) * static_cast <size_t> (size_n));
+    void _repage (T*& p) {
+      if (! p) return;
+      void* tmp = realloc_pages (p, (reinterpret_cast <chunk*> (p) - 1)->bytes, _pages);
+      if (! tmp) _err (__FILE__, __LINE__, "memory reallocation failed\n");
+      p = static_cast <T*> (tmp);
+    }
+    template <typename T>
+    static size_t _huge_size (const T* p) {
+      const chunk* c = p ? reinterpret_cast <const chunk*> (p) - 1 : 0;
+      return c && c->pages != SMALL_PAGES ? c->mapped : 0;
+    }
+    template <typename T>
+    void _copy_array (T*& p, const T* src, const int size) {
+      p = static_cast <T*> (realloc_pages (0, sizeof (T) * static_cast <size_t> (size), _pages));
+      if (! p) _err (__FILE__, __LINE__, "memory allocation failed\n");
+      std::memcpy (p, src, sizeof (T) * static_cast <size_t> (size));
+    }
+    template <typename T>
+    void _realloc_array (T*& p, const int size_n, const int size_p = 0) {
+      void* tmp = realloc_pages (p, sizeof (T) * static_cast <size_t> (size_n), _pages);
       if (! tmp)
-        std::free (p), _err (__FILE__, __LINE__, "memory reallocation failed\n");
+        free_pages (p), _err (__FILE__, __LINE__, "memory reallocation failed\n");
       p = static_cast <T*> (tmp);
       static const T T0 = T ();
       for (T* q (p + size_p), * const r (p + size_n); q != r; ++q) *q = T0;
     }
+    // the first sizeof (int) bytes of the tail are never used, so that no
+    // tail offset is taken for the base -1 of a node without children
+    static const char* _empty_tail () { static const char t[sizeof (int)] = {0}; return t; }
+    void _reset_tail () {
+      _tail_capacity = _tail_size = sizeof (int);
+      _realloc_array (_tail, _tail_size, 0);
+    }
     void _initialize () { // initilize the first special block
       _realloc_array (_array, 256, 256);
       _realloc_array (_ninfo, 256);
       _realloc_array (_block, 1);
-#ifdef USE_REDUCED_TRIE
-      _array[0] = node (-1, -1);
-#else
+      _reset_tail ();
       _array[0] = node (0, -1);
-#endif
       for (int i = 1; i < 256; ++i)
         _array[i] = node (i == 1 ? -255 : - (i - 1), i == 255 ? -1 : - (i + 1));
       _block[0].ehead = 1; // bug fix for erase
@@ -439,27 +572,128 @@ namespace cedar {
         to = _resolve (from, base, label, cf);
       return to;
     }
+    // the value of a tail whose '\0' is at offset
+    int _tail_value (const size_t offset) const {
+      int v = 0;
+      std::memcpy (&v, _tail + _align (offset + 1), sizeof (int));
+      return v;
+    }
+    static size_t _align (const size_t offset)
+    { return (offset + sizeof (int) - 1) & ~ (sizeof (int) - 1); }
+    // position offset in the tail of leaf node
+    size_t _tail_pos (const size_t node, const size_t offset) const
+    { return offset == static_cast <size_t> (- _array[node].base_) ? node : node | offset << 32; }
     // find key from double array
     int _find (const char* key, size_t& from, size_t& pos, const size_t len) const {
-      for (const uchar* const key_ = reinterpret_cast <const uchar*> (key);
-           pos < len; ) { // follow link
-#ifdef USE_REDUCED_TRIE
-        if (_array[from].value >= 0) break;
-#endif
-        size_t to = static_cast <size_t> (_array[from].base ()); to ^= key_[pos];
+      size_t offset = from >> 32;
+      if (! offset) {
+        for (const uchar* const key_ = reinterpret_cast <const uchar*> (key);
+             _array[from].base_ >= 0; ) { // follow link
+          if (pos == len) {
+            const node n = _array[_array[from].base () ^ 0];
+            if (n.check != static_cast <int> (from)) return CEDAR_NO_VALUE;
+            return n.base_;
+          }
+          size_t to = static_cast <size_t> (_array[from].base ()); to ^= key_[pos];
+          if (_array[to].check != static_cast <int> (from)) return CEDAR_NO_PATH;
+          ++pos;
+          from = to;
+        }
+        offset = static_cast <size_t> (- _array[from].base_);
+      }
+      // match the rest of the key in the tail
+      const size_t node_ = from & TAIL_MASK;
+      const char* const tail = _tail + offset;
+      size_t i = 0;
+      while (pos < len && tail[i] && tail[i] == key[pos]) ++i, ++pos;
+      from = _tail_pos (node_, offset + i);
+      if (pos < len) return CEDAR_NO_PATH;
+      if (tail[i])   return CEDAR_NO_VALUE;
+      return _tail_value (offset + i);
+    }
+    // the next prefix of key[0, len) from pos that is a key; below a leaf
+    // only the end of its suffix can be one, matched in a single pass
+    int _find_prefix (const char* key, size_t& from, size_t& pos, const size_t len) const {
+      bool step = false;
+      if (! (from >> 32) && _array[from].base_ >= 0) {
+        size_t to = static_cast <size_t> (_array[from].base ()); to ^= static_cast <uchar> (key[pos]);
         if (_array[to].check != static_cast <int> (from)) return CEDAR_NO_PATH;
         ++pos;
         from = to;
+        if (_array[from].base_ >= 0) {
+          const node n = _array[_array[from].base () ^ 0];
+          if (n.check != static_cast <int> (from)) return CEDAR_NO_VALUE;
+          return n.base_;
+        }
+        step = true;
       }
-#ifdef USE_REDUCED_TRIE
-      if (_array[from].value >= 0) // get value from leaf
-        return pos == len ? _array[from].value : CEDAR_NO_PATH; // only allow integer key
-#endif
-      const node n = _array[_array[from].base () ^ 0];
-      if (n.check != static_cast <int> (from)) return CEDAR_NO_VALUE;
-      return n.base_;
+      const size_t offset = (from >> 32) ? from >> 32 : static_cast <size_t> (- _array[from].base_);
+      const char* const tail = _tail + offset;
+      size_t i = 0;
+      while (pos < len && tail[i] && tail[i] == key[pos]) ++i, ++pos;
+      if (tail[i] || (! i && ! step)) return CEDAR_NO_PATH; // no match, or reported before
+      from = _tail_pos (from & TAIL_MASK, offset + i);
+      return _tail_value (offset + i);
+    }
+    // key[pos, len) as the tail of the new leaf to
+    value_type& _push_tail (const size_t to, size_t& pos, const char* key, const size_t len, const value_type val) {
+      const size_t offset = static_cast <size_t> (_tail_size);
+      const size_t value  = _align (offset + len - pos + 1);
+      if (value + sizeof (int) > static_cast <size_t> (CEDAR_VALUE_LIMIT))
+        _err (__FILE__, __LINE__, "tail is too large\n");
+      if (value + sizeof (int) > static_cast <size_t> (_tail_capacity)) {
+        int capacity = _tail_capacity;
+        while (static_cast <size_t> (capacity) < value + sizeof (int))
+          capacity = capacity > CEDAR_VALUE_LIMIT / 2 ? CEDAR_VALUE_LIMIT : capacity * 2;
+        _realloc_array (_tail, capacity, _tail_size);
+        _tail_capacity = capacity;
+      }
+      std::memcpy (_tail + offset, key + pos, len - pos);
+      std::memset (_tail + offset + len - pos, 0, value - offset - len + pos);
+      _tail_size = static_cast <int> (value + sizeof (int));
+      _array[to].base_ = - static_cast <int> (offset);
+      pos = len;
+      value_type* const v = reinterpret_cast <value_type*> (_tail + value);
+      *v = value_type (0);
+      return *v += val;
+    }
+    // insert key[pos, len) below the leaf from: the bytes it shares with the
+    // suffix of the leaf become nodes, under which the leaf keeps the rest
+    // of its suffix in place
+    template <typename T>
+    value_type& _split (size_t& from, size_t& pos, const char* key, const size_t len, const value_type val, T& cf) {
+      const size_t offset = static_cast <size_t> (- _array[from].base_);
+      size_t m = 0;
+      while (pos + m < len && _tail[offset + m] && _tail[offset + m] == key[pos + m]) ++m;
+      if (pos + m == len && ! _tail[offset + m]) { // key exists
+        pos = len;
+        return *reinterpret_cast <value_type*> (_tail + _align (offset + m + 1)) += val;
+      }
+      for (size_t i = 0; i < m; ++i)
+        from = static_cast <size_t> (_follow (from, static_cast <uchar> (_tail[offset + i]), cf));
+      pos += m;
+      const uchar c = static_cast <uchar> (_tail[offset + m]);
+      const int to = _follow (from, c, cf);
+      if (c)
+        _array[to].base_ = - static_cast <int> (offset + m + 1);
+      else
+        _array[to].base_ = _tail_value (offset + m);
+      if (pos == len) {
+        const int to_ = _follow (from, 0, cf);
+        return _array[to_].value += val;
+      }
+      from = static_cast <size_t> (_follow (from, static_cast <uchar> (key[pos]), cf));
+      ++pos;
+      return _push_tail (from, pos, key, len, val);
+    }
+    // the value of leaf from, with len extended by its suffix
+    int _leaf (size_t& from, size_t& len) const {
+      const size_t offset = (from >> 32) ? from >> 32 : static_cast <size_t> (- _array[from].base_);
+      const size_t n = std::strlen (_tail + offset);
+      len += n;
+      from = (from & TAIL_MASK) | offset << 32;
+      return _tail_value (offset + n);
     }
-#ifndef USE_FAST_LOAD
     void _restore_ninfo () {
       _realloc_array (_ninfo, _size);
       for (int to = 0; to < _size; ++to) {
@@ -478,12 +712,11 @@ namespace cedar {
         block& b = _block[bi];
         b.num = 0;
         for (; e < (bi << 8) + 256; ++e)
-          if (_array[e].check < 0 && ++b.num == 1) b.ehead = e;
+          if (e && _array[e].check < 0 && ++b.num == 1) b.ehead = e; // the root (check -1) is not empty
         int& head_out = b.num == 1 ? _bheadC : (b.num == 0 ? _bheadF : _bheadO);
         _push_block (bi, head_out, ! head_out && b.num);
       }
     }
-#endif
     void _set_result (result_type* x, value_type r, size_t = 0, size_t = 0) const
     { *x = r; }
     void _set_result (result_pair_type* x, value_type r, size_t l, size_t = 0) const
@@ -552,13 +785,8 @@ namespace cedar {
           _transfer_block (bi, _bheadO, _bheadC);
       }
       // initialize the released node
-#ifdef USE_REDUCED_TRIE
-      n.value = CEDAR_VALUE_LIMIT; n.check = from;
-      if (base < 0) _array[from].base_ = - (e ^ label) - 1;
-#else
       if (label) n.base_ = -1; else n.value = value_type (0); n.check = from;
       if (base < 0) _array[from].base_ = e ^ label;
-#endif
       return e;
     }
     // push empty node into empty ring
@@ -659,11 +887,7 @@ namespace cedar {
       const int from  = flag ? static_cast <int> (from_n) : from_p;
       const int base_ = flag ? base_n : base_p;
       if (flag && *first == label_n) _ninfo[from].child = label_n; // new child
-#ifdef USE_REDUCED_TRIE
-      _array[from].base_ = -base - 1; // new base
-#else
       _array[from].base_ = base; // new base
-#endif
       for (const uchar* p = first; p <= last; ++p) { // to_ => to
         const int to  = _pop_enode (base, *p, from);
         const int to_ = base_ ^ *p;
@@ -672,11 +896,7 @@ namespace cedar {
         cf (to_, to); // user-defined callback function to handle moved nodes
         node& n  = _array[to];
         node& n_ = _array[to_];
-#ifdef USE_REDUCED_TRIE
-        if ((n.base_ = n_.base_) < 0 && *p) // copy base; bug fix
-#else
-        if ((n.base_ = n_.base_) > 0 && *p) // copy base; bug fix
-#endif
+        if ((n.base_ = n_.base_) > 0 && *p) // copy base (or tail offset of a leaf); bug fix
           {
             uchar c = _ninfo[to].child = _ninfo[to_].child;
             do _array[n.base () ^ c].check = to; // adjust grand son's check
@@ -687,11 +907,7 @@ namespace cedar {
         if (! flag && to_ == to_pn) { // the address is immediately used
           _push_sibling (from_n, to_pn ^ label_n, label_n);
           _ninfo[to_].child = 0; // remember to reset child
-#ifdef USE_REDUCED_TRIE
-          n_.value = CEDAR_VALUE_LIMIT;
-#else
           if (label_n) n_.base_ = -1; else n_.value = value_type (0);
-#endif
           n_.check = static_cast <int> (from_n);
         } else
           _push_enode (to_);
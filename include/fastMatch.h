@@ -11,12 +11,30 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <numeric>
 #include <iostream>
 #include <functional>
 #include <fstream>
 #include <thread>
+#include <memory>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "acAutomaton.h"
+#include "keyTable.h"
+#include "output.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "simdSearch.h"
+#include "startTable.h"
+#include "staticTrie.h"
+#include "teddy.h"
+#include "trieBuilder.h"
 
 #ifndef USE_PREFIX_TRIE
 #include "cedar.h"
@@ -29,6 +47,14 @@ typedef cedar::da<int> trie;
 
 using namespace std;
 
+// text argument of the matching methods: a string_view where available, so
+// that callers can pass any character range without building a string
+#if __cplusplus >= 201703L
+typedef string_view text_ref;
+#else
+typedef const string& text_ref;
+#endif
+
 #if __cplusplus >= 201703L
 inline int match(string_view text, string_view pattern) {
   if (text.empty() || pattern.empty())
@@ -53,11 +79,16 @@ inline int match(string_view text, string_view pattern) {
   if (it == text.end())
     return -1;
   return it - text.begin();
-#else
+#elif USE_STRSTR
   auto address = strstr(text.data(), pattern.data());
   if (address == NULL)
     return -1;
   return address - text.data();
+#else
+  auto address = SimdSearch(text.data(), text.size(), pattern.data(), pattern.size());
+  if (address == NULL)
+    return -1;
+  return address - text.data();
 #endif
 }
 #else
@@ -69,16 +100,21 @@ inline int match(const string& text, const string& pattern) {
   if (pos == string::npos)
     return -1;
   return pos;
-#else
+#elif USE_STRSTR
   auto address = strstr(text.data(), pattern.data());
   if (address == NULL)
     return -1;
   return address - text.data();
+#else
+  auto address = SimdSearch(text.data(), text.size(), pattern.data(), pattern.size());
+  if (address == NULL)
+    return -1;
+  return address - text.data();
 #endif
 }
 #endif
 
-inline vector<int> matchPos(const string& text, const string& pattern) {
+inline vector<int> matchPos(text_ref text, text_ref pattern) {
   vector<int> res;
   if (text.empty() || pattern.empty())
     return res;
@@ -89,12 +125,20 @@ inline vector<int> matchPos(const string& text, const string& pattern) {
     res.emplace_back(pos);
     pos = text.find(pattern, pos + n);
   }
-#else
+#elif USE_STRSTR
   auto address = strstr(text.data(), pattern.data());
   while (address != NULL) {
     res.emplace_back(address - text.data());
     address = strstr(address + n, pattern.data());
   }
+#else
+  const char* str = text.data();
+  const char* end = str + text.size();
+  auto address = SimdSearch(str, text.size(), pattern.data(), n);
+  while (address != NULL) {
+    res.emplace_back(address - str);
+    address = SimdSearch(address + n, end - address - n, pattern.data(), n);
+  }
 #endif
   return res;
 }
@@ -114,37 +158,112 @@ inline void RunMultiThread(function<void(size_t, size_t)> func, size_t n, int nu
     t.join();
 }
 
+// Format every text with func(text, out) on num_threads threads, each into
+// its own buffer, and write the buffers to stdout in text order with bulk
+// writev() calls instead of a serial iostream loop. Threads take byte-sized
+// chunks of texts from a shared counter, so a few long texts do not leave
+// the other threads idle. With pin, the threads are pinned to CPUs spread
+// over the NUMA nodes. Returns false if writing the output failed.
+inline bool RunOrdered(const vector<string>& text, function<void(const string&, string&)> func,
+    int num_threads, bool pin = false) {
+  size_t n = text.size();
+  cout.flush();
+  OrderedWriter writer(STDOUT_FILENO);
+  auto run = [&](size_t start, size_t end) {
+    string out;
+    size_t first = start;
+    for (size_t i = start; i < end; ++i) {
+      func(text[i], out);
+      if (out.size() >= outputBufferSize) {
+        writer.commit(first, i + 1, out);
+        first = i + 1;
+      }
+    }
+    writer.commit(first, end, out);
+  };
+  // single thread processing
+  if (num_threads == 1)
+    run(0, n);
+  // multithread processing, balanced by bytes
+  else
+    RunChunked(run, ChunkBounds(text, num_threads), num_threads, pin);
+  return !writer.failed();
+}
+
+// Compute func(text[i]) for every text on num_threads threads and return the
+// results in text order. Each thread writes its own slots, so no locking is
+// needed, and the work is balanced by bytes like RunOrdered().
+template <class Result, class Func>
+inline vector<Result> RunBatch(const vector<string>& text, Func func, int num_threads,
+    bool pin = false) {
+  size_t n = text.size();
+  vector<Result> res(n);
+  if (num_threads <= 0)
+    num_threads = thread::hardware_concurrency();
+  auto run = [&](size_t start, size_t end) {
+    for (size_t i = start; i < end; ++i)
+      res[i] = func(text[i]);
+  };
+  if (num_threads == 1)
+    run(0, n);
+  else
+    RunChunked(run, ChunkBounds(text, num_threads), num_threads, pin);
+  return res;
+}
+
+inline void formatSingleMatch(const string& text, const string& pattern, string& out) {
+  if (match(text, pattern) >= 0) {
+    out.append(text);
+    out.push_back('\n');
+  }
+}
+
 inline void SingleMatch(const vector<string>& text, const string& pattern, int num_threads = 0) {
   if (text.empty() || pattern.empty())
     return;
   if (num_threads <= 0)
     num_threads = thread::hardware_concurrency();
-  // single thread processing
-  size_t n = text.size();
-  if (num_threads == 1) {
-    for (size_t i = 0; i < n; ++i)
-      if (match(text[i], pattern) >= 0)
-        cout << text[i] << '\n';
+  auto func = [&](const string& str, string& out) {
+    formatSingleMatch(str, pattern, out);
+  };
+  RunOrdered(text, func, num_threads);
+}
+
+inline void SingleMatch(istream& in, const string& pattern, int num_threads = 0,
+    size_t batch_size = 0) {
+  if (pattern.empty())
     return;
-  }
-  // multithread processing
-  bool v[n];
-#ifdef USE_OMP
-#pragma omp parallel for num_threads(num_threads)
-  for (size_t i = 0; i < n; ++i)
-    v[i] = match(text[i], pattern) >= 0;
-#else
-  auto func = [&](size_t start, size_t end) {
-    for (size_t i = start; i < end; ++i)
-      v[i] = match(text[i], pattern) >= 0;
+  auto func = [&](const string& str, string& out) {
+    formatSingleMatch(str, pattern, out);
   };
-  RunMultiThread(func, n, num_threads);
-#endif
-  for (size_t i = 0; i < n; ++i)
-    if (v[i])
-      cout << text[i] << '\n';
+  RunPipeline(in, STDOUT_FILENO, func, num_threads, batch_size);
 }
 
+inline uint64_t fnv1a(const void* data, size_t len, uint64_t hash = 0xcbf29ce484222325ULL) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < len; ++i)
+    hash = (hash ^ p[i]) * 0x100000001b3ULL;
+  return hash;
+}
+
+// Layout of an index file written by FastMatch::save(): this header, the
+// trie node array, the key offsets and the key bytes, each section padded
+// to 8 bytes. Integers are stored in native byte order.
+struct IndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t unit_size;
+  uint64_t num_nodes;
+  uint64_t num_keys;
+  uint64_t key_bytes;
+  uint64_t checksum;  // FNV-1a of everything after the header
+  uint64_t tail_bytes;  // tail of the prefix trie (USE_PREFIX_TRIE), else 0
+  uint64_t reserved[1];
+};
+
+#define INDEX_MAGIC "FMINDEX"
+#define INDEX_VERSION 1
+
 inline int charCount(const char* str, size_t len) {
   size_t cur = 0, num = 0;
   while (cur < len) {
@@ -156,10 +275,47 @@ inline int charCount(const char* str, size_t len) {
   return num;
 }
 
+// Matches of a batch of texts as integer columns: match j is key id[j] at
+// character start[j] of text text[j], length[j] characters long. The
+// matches of text i are [offset[i], offset[i + 1]) (CSR layout).
+struct MatchColumns {
+  vector<int32_t> id;
+  vector<int32_t> start;
+  vector<int32_t> length;
+  vector<int32_t> text;
+  vector<int64_t> offset;
+};
+
+// Bytes held by a FastMatch, by part. Parts served from a mapped index
+// file count in mapped as well: they live in the page cache, shared by the
+// processes that map the file.
+struct MemoryUsage {
+  size_t nodes = 0;      // cedar trie nodes, up to its capacity
+  size_t tail = 0;       // key suffixes of the prefix trie (USE_PREFIX_TRIE)
+  size_t ninfo = 0;      // cedar child and sibling labels, for updates
+  size_t blocks = 0;     // cedar free slot records, for updates
+  size_t frozen = 0;     // StaticTrie units
+  size_t keys = 0;       // key table, or value nodes with compact keys
+  size_t start = 0;      // start table
+  size_t automaton = 0;
+  size_t teddy = 0;
+  size_t mapped = 0;
+  size_t huge = 0;       // parts in huge page mappings (FastMatch::setPages())
+
+  size_t total() const {
+    return nodes + tail + ninfo + blocks + frozen + keys + start + automaton + teddy;
+  }
+};
+
+// The const methods keep no shared scratch state (scan buffers are per
+// thread), so any number of threads may match against one FastMatch at once.
+// Methods that change the keys must not run concurrently with them.
 class FastMatch : public trie {
   public:
+  // The trie is built from the sorted keys in one pass, with the subtrees
+  // of the first bytes spread over num_threads threads (0: all cores).
   FastMatch() {}
-  FastMatch(const string& filename, size_t capacity = 0) {
+  FastMatch(const string& filename, size_t capacity = 0, int num_threads = 1) {
     ifstream in(filename);
     if (!in.is_open()) {
       cerr << "Failed to load key file!\n";
@@ -170,88 +326,452 @@ class FastMatch : public trie {
       _key.reserve(capacity);
     while (getline(in, key))
       if (key.size())
-        _key.emplace_back(key);
+        _key.push_back(key);
     _size = _key.size();
-    build(_size, _key, 0);
+    buildTrie(num_threads);
   }
-  FastMatch(const vector<string>& key) : _key(key) {
+  FastMatch(const vector<string>& key, int num_threads = 1) : _key(key) {
     _size = _key.size();
-    build(_size, _key, 0);
+    buildTrie(num_threads);
+  }
+  // Deep copy: the copy owns its trie, keys and prefilters even when other
+  // is mapped from an index file. The overlay of a layer() is merged into a
+  // copy of its base, with the same ids.
+  FastMatch(const FastMatch& other) : FastMatch(other._base ? *other._base : other, Own()) {
+    if (other._base)
+      merge(other);
+  }
+  ~FastMatch() {
+    if (_map)
+      munmap(_map, _mapSize);
   }
   
   size_t size() const { return _size; }
+
+  size_t num_keys() const {
+    size_t num = _frozen ? _frozen->num_keys() : trie::num_keys();
+    return _base ? num + _base->num_keys() - _removed.size() : num;
+  }
+
+  // A new version of v that shares the trie and the keys of v, or of the
+  // base of v if v is a layer itself, and holds only the keys inserted and
+  // removed since: its own trie of the inserted keys, and the ids of the
+  // base that were removed. insert(), remove() and apply() on it cost about
+  // the size of the change, and the matching methods merge the matches of
+  // the base, without the removed ids, with those of the own trie. Ids go
+  // on from those of v. freeze(), compactKeys() and relayout() are not
+  // available on a layer; a copy of it is a flat FastMatch. frozen(),
+  // compact() and memoryUsage() describe the own parts.
+  static shared_ptr<FastMatch> layer(const shared_ptr<const FastMatch>& v) {
+    if (v->_base)
+      return shared_ptr<FastMatch>(new FastMatch(*v, Own()));
+    shared_ptr<FastMatch> res = make_shared<FastMatch>();
+    res->_base = v;
+    res->_first = res->_size = v->_size;
+    return res;
+  }
+
+  // the number of keys inserted and ids removed in a layer
+  size_t layerSize() const { return _base ? _size - _first + _removed.size() : 0; }
+
+  // Convert the trie into a StaticTrie, a densely packed read-only double
+  // array that all matching methods use from then on, and release the cedar
+  // trie. For deployments that do not update keys after loading: insert()
+  // and remove() rebuild the cedar trie first. Returns -1 if the trie is
+  // too large to freeze, the keys are compact or this is a layer().
+  int freeze() {
+    if (_frozen)
+      return 0;
+    if (_compact || _base)
+      return -1;
+    vector<KeyEntry> entry;
+    entry.reserve(_size);
+    for (size_t i = 0; i < _size; ++i)
+      if (exactMatchSearch<int>(_key.data(i), _key.length(i)) == static_cast<int>(i))
+        entry.push_back({_key.data(i), _key.length(i), static_cast<int>(i)});
+    unique_ptr<StaticTrie> frozen(new StaticTrie());
+    if (frozen->build(entry) != 0)
+      return -1;
+    trie::clear();
+    _frozen = move(frozen);
+    buildStart();
+    return 0;
+  }
+
+  bool frozen() const { return _frozen != nullptr; }
+  const StaticTrie* staticTrie() const { return _frozen.get(); }
+
+  // Drop the key table and keep, for every id, the trie node that holds
+  // its value: 4 bytes per key instead of the key bytes and their offset.
+  // getKey() then spells a key by following the parents of that node up to
+  // the root; the matching methods take the keys from the texts and are
+  // unaffected. The key of a removed or repeated id becomes "". A frozen
+  // trie has no parent links, so neither can be combined: returns -1. The
+  // same holds for the prefix trie, which keeps key suffixes in its tail,
+  // and for a layer().
+  int compactKeys() {
+    if (_compact)
+      return 0;
+#ifdef USE_PREFIX_TRIE
+    return -1;
+#else
+    if (_frozen || _base)
+      return -1;
+    vector<int> leaf(_size, -1);
+    for (size_t i = 0; i < _size; ++i) {
+      size_t from = 0, pos = 0;
+      if (traverse(_key.data(i), from, pos, _key.length(i)) == static_cast<int>(i))
+        leaf[i] = nodes()[from].base();
+    }
+    _leaf.swap(leaf);
+    _key.clear();
+    _key.shrink();
+    _compact = true;
+    return 0;
+#endif
+  }
+
+  bool compact() const { return _compact; }
+
+  // Renumber the trie nodes for cache locality (TrieBuilder::relayout):
+  // breadth first over the whole trie, or, given sample texts, with the
+  // nodes that their searches pass through most often first. Matching
+  // results are unchanged and the trie still takes updates; a mapped index
+  // is copied into private memory first. Returns -1 for a frozen trie,
+  // which is packed already, for the prefix trie and for a layer().
+  int relayout(const vector<string>& sample = vector<string>()) {
+#ifdef USE_PREFIX_TRIE
+    (void)sample;
+    return -1;
+#else
+    if (_frozen || _base)
+      return -1;
+    detach();
+    vector<uint32_t> visits;
+    if (sample.size())
+      visits = countVisits(sample);
+    vector<pair<string, int>> keys = liveKeys();
+    vector<KeyEntry> entry;
+    entry.reserve(keys.size());
+    for (auto& k : keys)
+      entry.push_back({k.first.data(), k.first.size(), k.second});
+    TrieBuilder<trie>::relayout(entry, *this, sample.size() ? &visits : nullptr);
+    if (_compact) {
+      fill(_leaf.begin(), _leaf.end(), -1);
+      for (auto& k : keys) {
+        size_t from = 0, pos = 0;
+        traverse(k.first.data(), from, pos, k.first.size());
+        _leaf[k.second] = nodes()[from].base();
+      }
+    }
+    buildStart();
+    return 0;
+#endif
+  }
+
+  MemoryUsage memoryUsage() const {
+    MemoryUsage res;
+    res.nodes = array_size();
+    res.tail = tailCapacity();
+    res.ninfo = ninfo_size();
+    res.blocks = block_size();
+    res.frozen = _frozen ? _frozen->total_size() : 0;
+    res.keys = _key.memoryUsage() + _leaf.capacity() * sizeof(int);
+    res.start = _start.memoryUsage();
+    res.automaton = _ac ? _ac->memoryUsage() : 0;
+    res.teddy = _teddy ? sizeof(Teddy) : 0;
+    if (_map)
+      res.mapped = (trieMapped() ? res.nodes + res.tail : 0) + _key.memoryUsage();
+    res.huge = huge_size();
+    return res;
+  }
+
+  // Allocate the arrays of the cedar trie in pages of the given type from
+  // now on and move them there: HUGE_PAGES for transparent 2 MB huge pages,
+  // HUGETLB_PAGES for the huge pages reserved in /proc/sys/vm/nr_hugepages,
+  // SMALL_PAGES for malloc. With a trie larger than the last level cache
+  // most node visits would miss the TLB with 4 KB pages. A trie mapped from
+  // an index file, which the kernel backs by 4 KB pages, is copied; the
+  // keys stay mapped. Constructors build in small pages, so this moves the
+  // trie once, while load() after it copies the index into huge pages
+  // directly.
+  void setPages(page_type pages) {
+    set_pages(pages);
+  }
+
+  // Release the spare capacity that building and inserting leave behind.
+  // With finalize, also release the ninfo and block records of the cedar
+  // trie, which only insert() and remove() use; they restore them from the
+  // nodes on their next call.
+  void shrink(bool finalize = false) {
+    shrink_to_fit(finalize);
+    _key.shrink();
+    _leaf.shrink_to_fit();
+  }
+  
+  // Build an Aho-Corasick automaton over the current keys so that every
+  // matching method scans a text in a single pass. insert() and remove()
+  // drop the automaton; call buildAutomaton() again after updating keys.
+  void buildAutomaton() {
+    _teddy.reset();
+    vector<pair<string, int>> keys = liveKeys();
+    _ac.reset(new ACAutomaton());
+    _ac->build(keys);
+  }
+  
+  bool hasAutomaton() const { return _ac != nullptr; }
+
+  // Build a Teddy SIMD prefilter over the first bytes of the current keys.
+  // The matching methods then skip to the positions where a key may start
+  // and only look up the trie there. This pays off for small dictionaries
+  // (tens of keys); with many distinct key prefixes most positions pass the
+  // filter. The prefilter replaces an automaton and, like it, is dropped by
+  // insert() and remove().
+  void buildTeddy() {
+    _ac.reset();
+    vector<string> keys;
+    keys.reserve(_size);
+    for (auto& k : liveKeys())
+      keys.emplace_back(move(k.first));
+    _teddy.reset(new Teddy());
+    _teddy->build(keys);
+    if (_teddy->empty())
+      _teddy.reset();
+  }
+
+  bool hasTeddy() const { return _teddy != nullptr; }
   
   int insert(const string& key) {
-    int index = exactMatchSearch<int>(key.c_str(), key.size());
+    int index = lookup(key.c_str(), key.size());
     if (index < 0) {
-      update(key.c_str(), key.size(), _size);
+      detach();
+      thaw();
+      _ac.reset();
+      _teddy.reset();
+      size_t from = 0, pos = 0;
+      nodeMover mover = {*this};
+      update(key.c_str(), from, pos, key.size(), static_cast<int>(_size), mover);
+      updateStart(key[0]);
       ++_size;
-      _key.emplace_back(key);
+      if (_compact)
+        _leaf.push_back(nodes()[from].base());
+      else
+        _key.push_back(key);
       return _size - 1;
     }
     return index;
   }
   
   int remove(const string& key) {
-    return erase(key.c_str(), key.size());
+    detach();
+    thaw();
+    int id = lookup(key.c_str(), key.size());
+    int ret = erase(key.c_str(), key.size());
+    if (ret != 0 && _base && id >= 0) {
+      // a key of the base: the layer hides its id
+      _removed.insert(upper_bound(_removed.begin(), _removed.end(), id), id);
+      ret = 0;
+    }
+    if (ret == 0) {
+      if (_compact)
+        _leaf[id] = -1;
+      updateStart(key[0]);
+      _ac.reset();
+      _teddy.reset();
+    }
+    return ret;
   }
   
+  // Remove, then insert, a batch of keys; new keys get the ids insert()
+  // would give them. A frozen trie is rebuilt once from the remaining and
+  // the new keys instead of being thawed into a cedar trie key by key and
+  // frozen again.
+  void apply(const vector<string>& removed, const vector<string>& added) {
+    if (!_frozen) {
+      for (auto& k : removed)
+        remove(k);
+      for (auto& k : added)
+        insert(k);
+      return;
+    }
+    detach();
+    vector<bool> dead(_size, false);
+    for (auto& k : removed) {
+      int id = lookup(k.data(), k.size());
+      if (id >= 0)
+        dead[id] = true;
+    }
+    size_t old = _size;
+    unordered_set<string> seen;
+    for (auto& k : added) {
+      int id = lookup(k.data(), k.size());
+      if (k.size() && (id < 0 || dead[id]) && seen.insert(k).second) {
+        _key.push_back(k);
+        ++_size;
+      }
+    }
+    if (_size == old && find(dead.begin(), dead.end(), true) == dead.end())
+      return;
+    dead.resize(_size, false);
+    refreeze(dead, old);
+  }
+
   string getKey(int id) const {
+    string res;
     if (id >= 0 && id < _size)
-      return _key[id];
-    return "";
+      appendKey(id, res);
+    return res;
   }
   
-  int getValue(const string& key) const {
-    return exactMatchSearch<int>(key.c_str(), key.size());
+  int getValue(text_ref key) const {
+    return lookup(key.data(), key.size());
   }
   
-  int hit(const string& text) const {
+  int hit(text_ref text) const {
     if (text.empty())
       return -1;
     trie::result_pair_type result_pair;
-    const char* str = text.c_str();
+    const char* str = text.data();
     size_t num = 0, cur = 0, len = text.size();
+    if (_ac) {
+      ACBuffer buf;
+      vector<ACMatch>& m = buf.get();
+      _ac->search(str, len, m, true);
+      if (m.empty())
+        return -1;
+      size_t k = 0;
+      acPrefixSearch(m, k, m[0].start, &result_pair, maxPrefixMatches, true);
+      return result_pair.value;
+    }
+    cur = nextStart(str, len, cur);
     while (cur < len) {
-      num = commonPrefixSearch(str + cur, len - cur, &result_pair, maxPrefixMatches);
+      num = prefixSearch(str + cur, len - cur, &result_pair, maxPrefixMatches, true);
       if (num)
         return result_pair.value;
-      ++cur;
-      while (cur < len && (str[cur] & 0xC0) == 0x80)
-        ++cur;
+      cur = nextStart(str, len, cur + 1);
     }
     return -1;
   }
   
-  vector<pair<string, int>> parse(const string& text) const {
-    vector<pair<string, int>> res;
-    if (text.empty())
-      return res;
+  // Visit every key occurring in text as visit(id, start, length), with
+  // start and length in bytes. At each UTF-8 character start the keys are
+  // reported from the shortest to the longest, as parse() lists them.
+  // Nothing is allocated per call, so ids can be resolved with getKey() or
+  // the bytes taken from text only where needed.
+  template <typename Visitor>
+  void forEachMatch(const char* str, size_t len, Visitor visit) const {
     trie::result_pair_type result_pair[maxPrefixMatches];
-    const char* str = text.c_str();
-    size_t num = 0, cur = 0, len = text.size();
+    size_t num = 0, cur = 0;
+    ACBuffer buf;
+    vector<ACMatch>& m = buf.get();
+    size_t k = 0;
+    if (_ac)
+      _ac->search(str, len, m);
+    cur = nextStart(str, len, cur);
     while (cur < len) {
-      num = commonPrefixSearch(str + cur, result_pair, maxPrefixMatches, len - cur);
+      num = _ac ? acPrefixSearch(m, k, cur, result_pair, maxPrefixMatches) :
+                  prefixSearch(str + cur, len - cur, result_pair, maxPrefixMatches);
       for (size_t i = 0; i < num; ++i)
-        res.emplace_back(_key[result_pair[i].value], cur);
-      ++cur;
-      while (cur < len && (str[cur] & 0xC0) == 0x80)
+        visit(result_pair[i].value, cur, result_pair[i].length);
+      cur = nextStart(str, len, cur + 1);
+    }
+  }
+  template <typename Visitor>
+  void forEachMatch(text_ref text, Visitor visit) const {
+    forEachMatch(text.data(), text.size(), visit);
+  }
+
+  // Visit the longest key at each position and continue after it, so the
+  // reported matches do not overlap (the matches of parse2()).
+  template <typename Visitor>
+  void forEachLongestMatch(const char* str, size_t len, Visitor visit) const {
+    trie::result_pair_type result_pair;
+    size_t num = 0, cur = 0;
+    ACBuffer buf;
+    vector<ACMatch>& m = buf.get();
+    size_t k = 0;
+    if (_ac)
+      _ac->search(str, len, m);
+    cur = nextStart(str, len, cur);
+    while (cur < len) {
+      num = _ac ? acPrefixSearch(m, k, cur, &result_pair, maxPrefixMatches, true) :
+                  prefixSearch(str + cur, len - cur, &result_pair, maxPrefixMatches, true);
+      if (num) {
+        visit(result_pair.value, cur, result_pair.length);
+        cur += result_pair.length;
+        continue;
+      }
+      cur = nextStart(str, len, cur + 1);
+    }
+  }
+  template <typename Visitor>
+  void forEachLongestMatch(text_ref text, Visitor visit) const {
+    forEachLongestMatch(text.data(), text.size(), visit);
+  }
+
+  // Visit the words of the maximum forward matching segmentation of text.
+  // Words that are not keys (runs of ASCII non-space bytes or single
+  // characters) are reported with id -1.
+  template <typename Visitor>
+  void forEachSegment(const char* str, size_t len, Visitor visit) const {
+    trie::result_pair_type result_pair;
+    size_t num = 0, cur = 0, last = 0;
+    ACBuffer buf;
+    vector<ACMatch>& m = buf.get();
+    size_t k = 0, next = 0;
+    if (_ac)
+      _ac->search(str, len, m);
+    while (cur < len) {
+      num = _ac ? acPrefixSearch(m, k, cur, &result_pair, maxPrefixMatches, true) :
+                  !mayStart(str, len, cur, next) ? 0 :
+                  prefixSearch(str + cur, len - cur, &result_pair, maxPrefixMatches, true);
+      if (num) {
+        visit(result_pair.value, cur, result_pair.length);
+        cur += result_pair.length;
+        continue;
+      }
+      last = cur;
+      while (cur < len && isascii(str[cur]) && !isspace(str[cur]))
         ++cur;
+      if (last == cur) {
+        ++cur;
+        while (cur < len && (str[cur] & 0xC0) == 0x80)
+          ++cur;
+      }
+      visit(-1, last, cur - last);
     }
+  }
+  template <typename Visitor>
+  void forEachSegment(text_ref text, Visitor visit) const {
+    forEachSegment(text.data(), text.size(), visit);
+  }
+
+  vector<pair<string, int>> parse(text_ref text) const {
+    vector<pair<string, int>> res;
+    forEachMatch(text, [&](int, size_t start, size_t length) {
+      res.emplace_back(string(text.data() + start, length), start);
+    });
     return res;
   }
-  
-  vector<pair<string, int>> parseBind(const string& text) const {
+
+  vector<pair<string, int>> parseBind(text_ref text) const {
     vector<pair<string, int>> res;
     if (text.empty())
       return res;
     trie::result_pair_type result_pair[maxPrefixMatches];
-    const char* str = text.c_str();
+    const char* str = text.data();
     size_t num = 0, cur = 0, idx = 0, len = text.size();
+    ACBuffer buf;
+    vector<ACMatch>& m = buf.get();
+    size_t k = 0, next = 0;
+    if (_ac)
+      _ac->search(str, len, m);
     while (cur < len) {
-      num = commonPrefixSearch(str + cur, result_pair, maxPrefixMatches, len - cur);
+      num = _ac ? acPrefixSearch(m, k, cur, result_pair, maxPrefixMatches) :
+                  !mayStart(str, len, cur, next) ? 0 :
+                  prefixSearch(str + cur, len - cur, result_pair, maxPrefixMatches);
       for (size_t i = 0; i < num; ++i)
-        res.emplace_back(_key[result_pair[i].value], idx);
+        res.emplace_back(string(str + cur, result_pair[i].length), idx);
       ++idx;
       ++cur;
       while (cur < len && (str[cur] & 0xC0) == 0x80)
@@ -260,38 +780,32 @@ class FastMatch : public trie {
     return res;
   }
   
-  vector<pair<string, int>> parse2(const string& text) const {
+  vector<pair<string, int>> parse2(text_ref text) const {
     vector<pair<string, int>> res;
-    if (text.empty())
-      return res;
-    trie::result_pair_type result_pair;
-    const char* str = text.c_str();
-    size_t num = 0, cur = 0, len = text.size();
-    while (cur < len) {
-      num = commonPrefixSearch(str + cur, len - cur, &result_pair, maxPrefixMatches);
-      if (num) {
-        res.emplace_back(_key[result_pair.value], cur);
-        cur += result_pair.length;
-        continue;
-      }
-      ++cur;
-      while (cur < len && (str[cur] & 0xC0) == 0x80)
-        ++cur;
-    }
+    forEachLongestMatch(text, [&](int, size_t start, size_t length) {
+      res.emplace_back(string(text.data() + start, length), start);
+    });
     return res;
   }
 
-  vector<pair<string, int>> parseBind2(const string& text) const {
+  vector<pair<string, int>> parseBind2(text_ref text) const {
     vector<pair<string, int>> res;
     if (text.empty())
       return res;
     trie::result_pair_type result_pair;
-    const char* str = text.c_str();
+    const char* str = text.data();
     size_t num = 0, cur = 0, idx = 0, len = text.size();
+    ACBuffer buf;
+    vector<ACMatch>& m = buf.get();
+    size_t k = 0, next = 0;
+    if (_ac)
+      _ac->search(str, len, m);
     while (cur < len) {
-      num = commonPrefixSearch(str + cur, len - cur, &result_pair, maxPrefixMatches);
+      num = _ac ? acPrefixSearch(m, k, cur, &result_pair, maxPrefixMatches, true) :
+                  !mayStart(str, len, cur, next) ? 0 :
+                  prefixSearch(str + cur, len - cur, &result_pair, maxPrefixMatches, true);
       if (num) {
-        res.emplace_back(_key[result_pair.value], idx);
+        res.emplace_back(string(str + cur, result_pair.length), idx);
         idx += charCount(str + cur, result_pair.length);
         cur += result_pair.length;
         continue;
@@ -304,50 +818,60 @@ class FastMatch : public trie {
     return res;
   }
 
-  string parseSingle(const string& text, int num_patterns = -1) const {
+  string parseSingle(text_ref text, int num_patterns = -1) const {
     string res;
     if (text.empty())
       return res;
     trie::result_pair_type result_pair[maxPrefixMatches];
-    const char* str = text.c_str();
+    const char* str = text.data();
     int count = 0;
     size_t num = 0, cur = 0, len = text.size();
+    ACBuffer buf;
+    vector<ACMatch>& m = buf.get();
+    size_t k = 0;
+    if (_ac)
+      _ac->search(str, len, m);
+    cur = nextStart(str, len, cur);
     while (cur < len) {
-      num = commonPrefixSearch(str + cur, result_pair, maxPrefixMatches, len - cur);
+      num = _ac ? acPrefixSearch(m, k, cur, result_pair, maxPrefixMatches) :
+                  prefixSearch(str + cur, len - cur, result_pair, maxPrefixMatches);
       for (int i = num - 1; i >= 0; --i) {
         ++count;
         res.push_back('\t');
-        res.append(_key[result_pair[i].value]);
+        res.append(str + cur, result_pair[i].length);
         if (num_patterns >= 0 && count >= num_patterns)
           return res;
       }
-      ++cur;
-      while (cur < len && (str[cur] & 0xC0) == 0x80)
-        ++cur;
+      cur = nextStart(str, len, cur + 1);
     }
     return res;
   }
   
-  string parseSingleFast(const string& text, int num_patterns = -1) const {
+  string parseSingleFast(text_ref text, int num_patterns = -1) const {
     string res;
     if (text.empty())
       return res;
     trie::result_pair_type result_pair;
-    const char* str = text.c_str();
+    const char* str = text.data();
     int count = 0;
     size_t num = 0, cur = 0, len = text.size();
+    ACBuffer buf;
+    vector<ACMatch>& m = buf.get();
+    size_t k = 0;
+    if (_ac)
+      _ac->search(str, len, m);
+    cur = nextStart(str, len, cur);
     while (cur < len) {
-      num = commonPrefixSearch(str + cur, len - cur, &result_pair, 1);
+      num = _ac ? acPrefixSearch(m, k, cur, &result_pair, 1, true) :
+                  prefixSearch(str + cur, len - cur, &result_pair, 1, true);
       if (num) {
         ++count;
         res.push_back('\t');
-        res.append(_key[result_pair.value]);
+        res.append(str + cur, result_pair.length);
         if (num_patterns >= 0 && count >= num_patterns)
           return res;
       }
-      ++cur;
-      while (cur < len && (str[cur] & 0xC0) == 0x80)
-        ++cur;
+      cur = nextStart(str, len, cur + 1);
     }
     return res;
   }
@@ -358,35 +882,10 @@ class FastMatch : public trie {
       return;
     if (num_threads <= 0)
       num_threads = thread::hardware_concurrency();
-    // single thread processing
-    size_t n = text.size();
-    if (num_threads == 1) {
-      for (size_t i = 0; i < n; ++i) {
-        string str = fast ? move(parseSingleFast(text[i], num_patterns)) :
-                            move(parseSingle(text[i], num_patterns));
-        if (str.size())
-          cout << text[i] << str << '\n';
-      }
-      return;
-    }
-    // multithread processing
-    vector<string> v(n);
-#ifdef USE_OMP
-#pragma omp parallel for num_threads(num_threads)
-    for (size_t i = 0; i < n; ++i)
-      v[i] = fast ? move(parseSingleFast(text[i], num_patterns)) :
-                    move(parseSingle(text[i], num_patterns));
-#else
-    auto func = [&](size_t start, size_t end) {
-      for (size_t i = start; i < end; ++i)
-        v[i] = fast ? move(parseSingleFast(text[i], num_patterns)) :
-                      move(parseSingle(text[i], num_patterns));
+    auto func = [&](const string& str, string& out) {
+      formatParse(str, fast, num_patterns, out);
     };
-    RunMultiThread(func, n, num_threads);
-#endif
-    for (size_t i = 0; i < n; ++i)
-      if (v[i].size())
-        cout << text[i] << v[i] << '\n';
+    RunOrdered(text, func, num_threads);
   }
   
   void parseHit(const vector<string>& text, int num_threads = 0) const {
@@ -394,157 +893,697 @@ class FastMatch : public trie {
       return;
     if (num_threads <= 0)
       num_threads = thread::hardware_concurrency();
-    // single thread processing
-    size_t n = text.size();
-    if (num_threads == 1) {
-      int val = -1;
-      for (size_t i = 0; i < n; ++i) {
-        val = hit(text[i]);
-        if (val >= 0)
-          cout << text[i] << '\t' << _key[val] << '\n';
-      }
-      return;
-    }
-    // multithread processing
-    int v[n];
-#ifdef USE_OMP
-#pragma omp parallel for num_threads(num_threads)
-    for (size_t i = 0; i < n; ++i)
-      v[i] = hit(text[i]);
-#else
-    auto func = [&](size_t start, size_t end) {
-      for (size_t i = start; i < end; ++i)
-        v[i] = hit(text[i]);
+    auto func = [&](const string& str, string& out) {
+      formatHit(str, out);
     };
-    RunMultiThread(func, n, num_threads);
-#endif
-    for (size_t i = 0; i < n; ++i)
-      if (v[i] >= 0)
-        cout << text[i] << '\t' << _key[v[i]] << '\n';
+    RunOrdered(text, func, num_threads);
+  }
+  
+  // streaming variants of the methods above: in is read in batches and the
+  // results are written in input order with bounded memory
+  void parse(istream& in, bool fast = false, int num_patterns = -1,
+      int num_threads = 0, size_t batch_size = 0) const {
+    auto func = [&](const string& str, string& out) {
+      formatParse(str, fast, num_patterns, out);
+    };
+    RunPipeline(in, STDOUT_FILENO, func, num_threads, batch_size);
+  }
+  
+  void parseHit(istream& in, int num_threads = 0, size_t batch_size = 0) const {
+    auto func = [&](const string& str, string& out) {
+      formatHit(str, out);
+    };
+    RunPipeline(in, STDOUT_FILENO, func, num_threads, batch_size);
+  }
+  
+  void maxForwardMatch(istream& in, int num_threads = 0, size_t batch_size = 0) const {
+    auto func = [&](const string& str, string& out) {
+      out.append(maxForwardMatchSingle(str));
+    };
+    RunPipeline(in, STDOUT_FILENO, func, num_threads, batch_size);
   }
   
-  vector<string> maxForwardMatch(const string& text) const {
+  vector<string> maxForwardMatch(text_ref text) const {
     vector<string> res;
-    if (text.empty())
-      return res;
-    trie::result_pair_type result_pair;
-    const char* str = text.c_str();
-    size_t num = 0, cur = 0, last = 0, len = text.size();
-    res.reserve(len >> 2);
-    while (cur < len) {
-      num = commonPrefixSearch(str + cur, len - cur, &result_pair, maxPrefixMatches);
-      if (num) {
-        res.emplace_back(_key[result_pair.value]);
-        cur += result_pair.length;
-        continue;
-      }
-      last = cur;
-      while (cur < len && isascii(str[cur]) && !isspace(str[cur]))
-        ++cur;
-      if (last == cur) {
-        ++cur;
-        while (cur < len && (str[cur] & 0xC0) == 0x80)
-          ++cur;
-      }
-      res.emplace_back(text.substr(last, cur - last));
-    }
+    res.reserve(text.size() >> 2);
+    forEachSegment(text, [&](int, size_t start, size_t length) {
+      res.emplace_back(text.data() + start, length);
+    });
     return res;
   }
-  
+
   #if __cplusplus >= 201703L
   vector<string_view> maxForwardMatchView(string_view text) const {
     vector<string_view> res;
-    if (text.empty())
-      return res;
-    trie::result_pair_type result_pair;
-    const char* str = text.data();
-    size_t num = 0, cur = 0, last = 0, len = text.size();
-    res.reserve(len >> 2);
-    while (cur < len) {
-      num = commonPrefixSearch(str + cur, len - cur, &result_pair, maxPrefixMatches);
-      if (num) {
-        res.emplace_back(_key[result_pair.value]);
-        cur += result_pair.length;
-        continue;
-      }
-      last = cur;
-      while (cur < len && isascii(str[cur]) && !isspace(str[cur]))
-        ++cur;
-      if (last == cur) {
-        ++cur;
-        while (cur < len && (str[cur] & 0xC0) == 0x80)
-          ++cur;
-      }
-      res.emplace_back(text.substr(last, cur - last));
-    }
+    res.reserve(text.size() >> 2);
+    forEachSegment(text, [&](int, size_t start, size_t length) {
+      res.emplace_back(text.substr(start, length));
+    });
     return res;
   }
   #endif
-  
-  string maxForwardMatchSingle(const string& text) const {
+
+  string maxForwardMatchSingle(text_ref text) const {
     string res;
     if (text.empty())
       return res;
-    trie::result_pair_type result_pair;
-    const char* str = text.c_str();
-    size_t num = 0, cur = 0, last = 0, len = text.size();
-    res.reserve(len * 4 / 3);
-    while (cur < len) {
-      num = commonPrefixSearch(str + cur, len - cur, &result_pair, maxPrefixMatches);
-      if (num) {
-        res.append(_key[result_pair.value]);
-        res.push_back(' ');
-        cur += result_pair.length;
-        continue;
-      }
-      last = cur;
-      while (cur < len && isascii(str[cur]) && !isspace(str[cur]))
-        ++cur;
-      if (last == cur) {
-        ++cur;
-        while (cur < len && (str[cur] & 0xC0) == 0x80)
-          ++cur;
-      }
-      res.append(str + last, cur - last);
+    res.reserve(text.size() * 4 / 3);
+    forEachSegment(text, [&](int, size_t start, size_t length) {
+      res.append(text.data() + start, length);
       res.push_back(' ');
-    }
+    });
     res.back() = '\n';
     return res;
   }
-  
+
   void maxForwardMatch(const vector<string>& text, int num_threads = 0) const {
     if (text.empty())
       return;
     if (num_threads <= 0)
       num_threads = thread::hardware_concurrency();
-    
-    // single thread processing
-    size_t n = text.size();
-    if (num_threads == 1) {
-      for (size_t i = 0; i < n; ++i)
-        cout << maxForwardMatchSingle(text[i]);
-      return;
+    auto func = [&](const string& str, string& out) {
+      out.append(maxForwardMatchSingle(str));
+    };
+    RunOrdered(text, func, num_threads);
+  }
+
+  // append the output line of text to out as the batch methods above write
+  // it: the text followed by its matches, or nothing without a match
+  void formatParse(const string& text, bool fast, int num_patterns, string& out) const {
+    string str = fast ? move(parseSingleFast(text, num_patterns)) :
+                        move(parseSingle(text, num_patterns));
+    if (str.size()) {
+      out.append(text);
+      out.append(str);
+      out.push_back('\n');
+    }
+  }
+
+  void formatHit(const string& text, string& out) const {
+    int val = hit(text);
+    if (val >= 0) {
+      out.append(text);
+      out.push_back('\t');
+      appendKey(val, out);
+      out.push_back('\n');
+    }
+  }
+
+  // batch variants of hit(), parseBind(), parseBind2() and maxForwardMatch()
+  // that return the result of every text instead of writing to stdout
+  vector<int> hitBatch(const vector<string>& text, int num_threads = 0) const {
+    return RunBatch<int>(text, [&](const string& str) { return hit(str); }, num_threads);
+  }
+
+  vector<vector<pair<string, int>>> parseBatch(const vector<string>& text,
+      int num_threads = 0) const {
+    return RunBatch<vector<pair<string, int>>>(text,
+        [&](const string& str) { return parseBind(str); }, num_threads);
+  }
+
+  vector<vector<pair<string, int>>> parse2Batch(const vector<string>& text,
+      int num_threads = 0) const {
+    return RunBatch<vector<pair<string, int>>>(text,
+        [&](const string& str) { return parseBind2(str); }, num_threads);
+  }
+
+  vector<vector<string>> maxForwardMatchBatch(const vector<string>& text,
+      int num_threads = 0) const {
+    return RunBatch<vector<string>>(text,
+        [&](const string& str) { return maxForwardMatch(str); }, num_threads);
+  }
+
+  // Matches of parse() (or of parse2() when longest) in columns, without
+  // building a string per match; keys can be resolved with getKey().
+  MatchColumns parseColumns(text_ref text, bool longest = false) const {
+    MatchColumns res;
+    res.offset.push_back(0);
+    appendColumns(text, longest, res);
+    res.text.resize(res.id.size(), 0);
+    res.offset.push_back(static_cast<int64_t>(res.id.size()));
+    return res;
+  }
+
+  MatchColumns parseColumnsBatch(const vector<string>& text, bool longest = false,
+      int num_threads = 0) const {
+    vector<MatchColumns> part = RunBatch<MatchColumns>(text, [&](const string& str) {
+      MatchColumns col;
+      appendColumns(str, longest, col);
+      return col;
+    }, num_threads);
+    MatchColumns res;
+    size_t total = 0;
+    for (auto& col : part)
+      total += col.id.size();
+    res.id.reserve(total);
+    res.start.reserve(total);
+    res.length.reserve(total);
+    res.text.reserve(total);
+    res.offset.reserve(text.size() + 1);
+    res.offset.push_back(0);
+    for (size_t i = 0; i < part.size(); ++i) {
+      res.id.insert(res.id.end(), part[i].id.begin(), part[i].id.end());
+      res.start.insert(res.start.end(), part[i].start.begin(), part[i].start.end());
+      res.length.insert(res.length.end(), part[i].length.begin(), part[i].length.end());
+      res.text.resize(res.id.size(), static_cast<int32_t>(i));
+      res.offset.push_back(static_cast<int64_t>(res.id.size()));
+    }
+    return res;
+  }
+
+  // Write the trie and the key table to a single index file. A frozen
+  // trie is saved as the cedar trie rebuilt from its keys, compact keys as
+  // the table of the spelled keys.
+  int save(const string& filename) const {
+    if (_frozen || _base) {
+      FastMatch copy(*this);
+      copy.thaw();
+      return copy.save(filename);
+    }
+    KeyTable spelled;
+    if (_compact) {
+      string key;
+      for (size_t i = 0; i < _size; ++i) {
+        key.clear();
+        appendKey(static_cast<int>(i), key);
+        spelled.push_back(key);
+      }
+    }
+    const KeyTable& keys = _compact ? spelled : _key;
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.unit_size = unit_size();
+    header.num_nodes = trie::size();
+    header.num_keys = _size;
+    header.key_bytes = keys.bytes();
+    header.tail_bytes = tailBytes();
+    const void* section[4] = {array(), tailData(), keys.offsets(), keys.arena()};
+    size_t length[4] = {total_size(), tailBytes(), (_size + 1) * sizeof(uint32_t),
+                        keys.bytes()};
+    const char pad[8] = {0};
+    header.checksum = fnv1a(nullptr, 0);
+    for (int i = 0; i < 4; ++i) {
+      header.checksum = fnv1a(section[i], length[i], header.checksum);
+      header.checksum = fnv1a(pad, padding(length[i]), header.checksum);
+    }
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp)
+      return -1;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (int i = 0; i < 4 && ok; ++i) {
+      if (length[i] == 0)  // an empty section may have no storage
+        continue;
+      ok = fwrite(section[i], 1, length[i], fp) == length[i] &&
+           fwrite(pad, 1, padding(length[i]), fp) == padding(length[i]);
+    }
+    return fclose(fp) == 0 && ok ? 0 : -1;
+  }
+
+  // Map an index file written by save() and serve the trie and the keys
+  // directly from the mapping, so that startup costs only page faults and
+  // processes share one page-cache copy. The section sizes and the key
+  // offsets are always checked, in one pass over the offsets; the checksum
+  // only when verify is set since it reads the whole file. The index is copied into
+  // private memory on the first insert() or remove(), and the trie at once
+  // with huge pages (setPages()).
+  int load(const string& filename, bool verify = false) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(IndexHeader)) {
+      close(fd);
+      return -1;
     }
-    // multithread processing
-    vector<string> v(n);
-#ifdef USE_OMP
-#pragma omp parallel for num_threads(num_threads)
-    for (size_t i = 0; i < n; ++i)
-      v[i] = move(maxForwardMatchSingle(text[i]));
+    size_t mapSize = st.st_size;
+    void* map = mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      return -1;
+    const char* base = static_cast<const char*>(map);
+    const IndexHeader* header = static_cast<const IndexHeader*>(map);
+    size_t room = mapSize - sizeof(IndexHeader);
+    size_t tail = header->tail_bytes;
+#ifdef USE_PREFIX_TRIE
+    bool tailOk = true;  // a plain cedar trie is a prefix trie without leaves
 #else
-    auto func = [&](size_t start, size_t end) {
-      for (size_t i = start; i < end; ++i)
-        v[i] = move(maxForwardMatchSingle(text[i]));
-    };
-    RunMultiThread(func, n, num_threads);
+    bool tailOk = tail == 0;
 #endif
-    for (size_t i = 0; i < n; ++i)
-      cout << v[i];
+    // each section must fit in the file before the sizes are added up
+    bool ok = memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+              header->version == INDEX_VERSION && header->unit_size == unit_size() &&
+              tailOk && header->num_nodes <= room / unit_size() && tail <= room &&
+              header->num_keys < room / sizeof(uint32_t) && header->key_bytes <= room;
+    size_t nodes = ok ? header->num_nodes * unit_size() : 0;
+    size_t offsets = ok ? (header->num_keys + 1) * sizeof(uint32_t) : 0;
+    size_t expect = sizeof(IndexHeader) + nodes + padding(nodes) + tail + padding(tail) +
+                    offsets + padding(offsets) + header->key_bytes + padding(header->key_bytes);
+    const char* keyBase = base + sizeof(IndexHeader) + nodes + padding(nodes) + tail +
+                          padding(tail);
+    // the key offsets are always checked, the checksum only on request
+    if (!ok || expect != mapSize ||
+        !KeyTable::valid(reinterpret_cast<const uint32_t*>(keyBase), header->num_keys,
+            header->key_bytes) ||
+        (verify && fnv1a(base + sizeof(IndexHeader), room) != header->checksum)) {
+      munmap(map, mapSize);
+      return -1;
+    }
+    _ac.reset();
+    _teddy.reset();
+    _frozen.reset();
+    _leaf.clear();
+    _compact = false;
+    _base.reset();
+    _removed.clear();
+    _first = 0;
+    base += sizeof(IndexHeader);
+#ifdef USE_PREFIX_TRIE
+    set_array(const_cast<char*>(base), header->num_nodes,
+        tail ? base + nodes + padding(nodes) : nullptr, tail);
+#else
+    set_array(const_cast<char*>(base), header->num_nodes);
+#endif
+    _key.attach(reinterpret_cast<const uint32_t*>(keyBase),
+        keyBase + offsets + padding(offsets), header->num_keys);
+    _size = header->num_keys;
+    if (_map)
+      munmap(_map, _mapSize);
+    _map = map;
+    _mapSize = mapSize;
+    if (pages() != SMALL_PAGES)
+      set_pages(pages());
+    buildStart();
+    return 0;
+  }
+
+  static bool isIndex(const string& filename) {
+    char magic[sizeof(INDEX_MAGIC)] = {0};
+    ifstream in(filename, ios::binary);
+    return in.read(magic, sizeof(magic)) && memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0;
   }
 
   private:
+  static size_t padding(size_t n) { return (8 - (n & 7)) & 7; }
+
+  struct Own {};
+
+  // copy the parts of other itself; a layer keeps sharing its base
+  FastMatch(const FastMatch& other, Own) : trie(other), _size(other._size), _key(other._key),
+      _leaf(other._leaf), _compact(other._compact), _start(other._start),
+      _base(other._base), _removed(other._removed), _first(other._first) {
+    _key.own();
+    if (other._ac)
+      _ac.reset(new ACAutomaton(*other._ac));
+    if (other._teddy)
+      _teddy.reset(new Teddy(*other._teddy));
+    if (other._frozen)
+      _frozen.reset(new StaticTrie(*other._frozen));
+  }
+
+  // Apply the layer other to this copy of its base with the ids of other:
+  // the removed ids are dropped and the keys of the layer appended in id
+  // order, those removed again as ids without a key in the trie.
+  void merge(const FastMatch& other) {
+    vector<bool> dead(other._size, false);
+    for (int id : other._removed)
+      dead[id] = true;
+    for (size_t i = other._first; i < other._size; ++i)
+      dead[i] = other.lookup(other._key.data(i - other._first),
+          other._key.length(i - other._first)) != static_cast<int>(i);
+    size_t old = _size;
+    if (_frozen) {
+      for (size_t i = old; i < other._size; ++i)
+        _key.push_back(other._key.data(i - other._first), other._key.length(i - other._first));
+      _size = other._size;
+      refreeze(dead, old);
+      return;
+    }
+    for (int id : other._removed)
+      remove(getKey(id));
+    for (size_t i = old; i < other._size; ++i) {
+      string key = other._key[i - other._first];
+      if (!dead[i]) {
+        insert(key);
+        continue;
+      }
+      if (_compact)
+        _leaf.push_back(-1);
+      else
+        _key.push_back(key);
+      ++_size;
+    }
+  }
+
+  // Rebuild the frozen trie over the ids before old that are still in it
+  // and the ids from old on, except those marked dead; a trie too large to
+  // freeze is served from cedar.
+  void refreeze(const vector<bool>& dead, size_t old) {
+    vector<KeyEntry> entry;
+    entry.reserve(_size);
+    for (size_t i = 0; i < _size; ++i)
+      if (!dead[i] && (i >= old || lookup(_key.data(i), _key.length(i)) == static_cast<int>(i)))
+        entry.push_back({_key.data(i), _key.length(i), static_cast<int>(i)});
+    unique_ptr<StaticTrie> frozen(new StaticTrie());
+    if (frozen->build(entry) == 0) {
+      _frozen = move(frozen);
+    } else {
+      // too large for a static trie: serve the keys from cedar
+      for (auto& e : entry)
+        update(e.key, e.length) = e.value;
+      _frozen.reset();
+    }
+    buildStart();
+    _ac.reset();
+    _teddy.reset();
+  }
+
+  // the tail of the prefix trie; none for cedar
+#ifdef USE_PREFIX_TRIE
+  const void* tailData() const { return tail(); }
+  size_t tailBytes() const { return tail_size(); }
+  size_t tailCapacity() const { return tail_capacity(); }
+#else
+  const void* tailData() const { return nullptr; }
+  size_t tailBytes() const { return 0; }
+  size_t tailCapacity() const { return 0; }
+#endif
+
+  // a repeated key keeps the id of its last occurrence; empty keys are
+  // skipped
+  void buildTrie(int num_threads) {
+    vector<KeyEntry> entry;
+    entry.reserve(_size);
+    for (size_t i = 0; i < _size; ++i)
+      if (_key.length(i))
+        entry.push_back({_key.data(i), _key.length(i), static_cast<int>(i)});
+#ifdef USE_PREFIX_TRIE
+    // the bulk builder lays out every key byte as a node; the prefix trie
+    // takes the keys one by one, in sorted order
+    (void)num_threads;
+    SortKeys(entry);
+    for (auto& e : entry)
+      update(e.key, e.length) = e.value;
+#else
+    TrieBuilder<trie>::build(entry, *this, num_threads);
+#endif
+    buildStart();
+  }
+
+  // follows the nodes that the trie relocates during update()
+  struct nodeMover {
+    FastMatch& fm;
+    void operator()(const int from, const int to) { fm.moveNode(from, to); }
+  };
+
+  // Called before node from is copied to to, when the parent already has
+  // its new base. A value node is the child with label 0, at that base.
+  void moveNode(int from, int to) {
+    _start.move(from, to);
+    const trie::node* n = nodes();
+    if (_compact && n[n[from].check].base() == to)
+      _leaf[n[from].value] = to;
+  }
+
+  const trie::node* nodes() const { return static_cast<const trie::node*>(array()); }
+
+  // append the key of id, spelled from its value node with compact keys
+  void appendKey(int id, string& out) const {
+    if (_base && id < static_cast<int>(_first)) {
+      _base->appendKey(id, out);
+      return;
+    }
+    if (!_compact) {
+      out.append(_key.data(id - _first), _key.length(id - _first));
+      return;
+    }
+    if (_leaf[id] < 0)
+      return;
+    const trie::node* n = nodes();
+    size_t start = out.size();
+    for (int to = n[_leaf[id]].check; to; to = n[to].check)
+      out.push_back(static_cast<char>(n[n[to].check].base() ^ to));
+    reverse(out.begin() + start, out.end());
+  }
+
+  // the keys in the trie with their ids
+  vector<pair<string, int>> liveKeys() const {
+    vector<pair<string, int>> res;
+    res.reserve(_size);
+    for (size_t i = 0; i < _size; ++i) {
+      if (_compact) {
+        if (_leaf[i] >= 0) {
+          res.emplace_back(string(), static_cast<int>(i));
+          appendKey(static_cast<int>(i), res.back().first);
+        }
+        continue;
+      }
+      string key;
+      appendKey(static_cast<int>(i), key);
+      if (lookup(key.data(), key.size()) == static_cast<int>(i))
+        res.emplace_back(move(key), static_cast<int>(i));
+    }
+    return res;
+  }
+
+  // the number of searches of sample through every trie node, from each
+  // position where the matching methods look up the trie
+  vector<uint32_t> countVisits(const vector<string>& sample) const {
+    vector<uint32_t> visits(trie::size());
+    const trie::node* n = nodes();
+    for (auto& text : sample) {
+      const char* str = text.data();
+      size_t len = text.size();
+      for (size_t cur = nextStart(str, len, 0); cur < len; cur = nextStart(str, len, cur + 1)) {
+        size_t from = 0;
+        // a NUL byte would step into a value node
+        for (size_t pos = cur; pos < len && str[pos]; ++pos) {
+          size_t to = n[from].base() ^ static_cast<unsigned char>(str[pos]);
+          if (n[to].check != static_cast<int>(from))
+            break;
+          visits[to] += visits[to] != UINT32_MAX;
+          from = to;
+        }
+      }
+    }
+    return visits;
+  }
+
+  void buildStart() {
+    _start.reset();
+    for (int c = 0; c < 256; ++c)
+      updateStart(static_cast<char>(c));
+  }
+
+  void updateStart(char c) {
+    if (_frozen)
+      updateStart(*_frozen, c);
+    else
+      updateStart<trie>(*this, c);
+  }
+
+  // recompute the start table entries of the keys beginning with byte c;
+  // label 0 marks values in the trie, so keys never contain a NUL byte
+  template <class Trie>
+  void updateStart(const Trie& t, char c) {
+    unsigned char c0 = static_cast<unsigned char>(c);
+    size_t from = 0, pos = 0;
+    int value = c0 ? t.traverse(&c, from, pos, 1) : static_cast<int>(CEDAR_NO_PATH);
+    if (value == CEDAR_NO_PATH) {
+      if (_start.firstNode(c0) >= 0)
+        for (unsigned c1 = 0; c1 < 256; ++c1)
+          _start.setPair(c0 << 8 | c1, -1, false);
+      _start.setFirst(c0, -1, false);
+      return;
+    }
+    _start.setFirst(c0, static_cast<int>(from), value >= 0);
+    for (unsigned c1 = 1; c1 < 256; ++c1) {
+      char b = static_cast<char>(c1);
+      size_t to = from;
+      pos = 0;
+      value = t.traverse(&b, to, pos, 1);
+      // a position inside a tail of the prefix trie (offset in the upper
+      // bits) is no node to resume at: 0 has the search restart at the root
+      _start.setPair(c0 << 8 | c1, value == CEDAR_NO_PATH ? -1 : to >> 32 ? 0 :
+          static_cast<int>(to), value >= 0);
+    }
+  }
+
+  // commonPrefixSearch of key[0, len) through the start table: positions
+  // whose first two bytes begin no key are rejected without touching the
+  // trie, and the search of the others resumes at the depth-2 node (node
+  // 0: from the root). With overwrite only the last (longest) match is kept
+  // in *result.
+  size_t prefixSearch(const char* key, size_t len, trie::result_pair_type* result,
+      size_t result_len, bool overwrite = false) const {
+    if (_base)
+      return layerSearch(key, len, result, result_len, overwrite);
+    return _frozen ? prefixSearch(*_frozen, key, len, result, result_len, overwrite) :
+                     prefixSearch<trie>(*this, key, len, result, result_len, overwrite);
+  }
+
+  // prefixSearch of a layer: the matches of the base without the removed
+  // ids and those of the own trie, merged from the shortest to the longest
+  size_t layerSearch(const char* key, size_t len, trie::result_pair_type* result,
+      size_t result_len, bool overwrite) const {
+    trie::result_pair_type a[maxPrefixMatches], b[maxPrefixMatches];
+    size_t nb = _frozen ? prefixSearch(*_frozen, key, len, b, maxPrefixMatches, false) :
+                          prefixSearch<trie>(*this, key, len, b, maxPrefixMatches, false);
+    if (!nb && _removed.empty())
+      return _base->prefixSearch(key, len, result, result_len, overwrite);
+    size_t na = _base->prefixSearch(key, len, a, maxPrefixMatches);
+    size_t i = 0, j = 0, num = 0;
+    while ((i < na || j < nb) && num < result_len) {
+      bool base = j == nb || (i < na && a[i].length < b[j].length);
+      const trie::result_pair_type& r = base ? a[i++] : b[j++];
+      if (base && binary_search(_removed.begin(), _removed.end(), r.value))
+        continue;
+      result[overwrite ? 0 : num] = r;
+      ++num;
+    }
+    return num;
+  }
+
+  template <class Trie>
+  size_t prefixSearch(const Trie& t, const char* key, size_t len,
+      trie::result_pair_type* result, size_t result_len, bool overwrite) const {
+    unsigned char c0 = static_cast<unsigned char>(key[0]);
+    if (!_start.first(c0))
+      return 0;
+    unsigned b = len < 2 ? 0 : c0 << 8 | static_cast<unsigned char>(key[1]);
+    int node = len < 2 || _start.shortKey(c0) ? 0 : _start.node(b);
+    if (node < 0)
+      return 0;
+    if (node == 0)
+      return overwrite ? t.commonPrefixSearch(key, len, result, result_len) :
+                         t.commonPrefixSearch(key, result, result_len, len);
+    size_t from = static_cast<size_t>(node), pos = 0, num = 0;
+    if (_start.pairKey(b)) {
+      result->value = t.traverse(key + 2, from, pos, 0);
+      result->length = 2;
+      if (++num == result_len)
+        return num;
+    }
+    trie::result_pair_type* rest = overwrite ? result : result + num;
+    size_t more = overwrite ?
+        t.commonPrefixSearch(key + 2, len - 2, rest, result_len - num, from) :
+        t.commonPrefixSearch(key + 2, rest, result_len - num, len - 2, from);
+    for (size_t i = 0; i < (overwrite ? min<size_t>(more, 1) : more); ++i)
+      rest[i].length += 2;
+    return num + more;
+  }
+
+  int lookup(const char* key, size_t len) const {
+    int id = _frozen ? _frozen->exactMatchSearch<int>(key, len) : exactMatchSearch<int>(key, len);
+    if (id >= 0 || !_base)
+      return id;
+    id = _base->lookup(key, len);
+    return id >= 0 && !binary_search(_removed.begin(), _removed.end(), id) ? id : -1;
+  }
+
+  // rebuild the cedar trie of a frozen one before it is modified
+  void thaw() {
+    if (!_frozen)
+      return;
+    for (size_t i = 0; i < _size; ++i)
+      if (_frozen->exactMatchSearch<int>(_key.data(i), _key.length(i)) == static_cast<int>(i))
+        update(_key.data(i), _key.length(i)) = static_cast<int>(i);
+    _frozen.reset();
+    buildStart();
+  }
+
+  // whether the trie is served from the mapped index file
+  bool trieMapped() const {
+    const char* p = static_cast<const char*>(array());
+    return _map && p >= static_cast<const char*>(_map) &&
+           p < static_cast<const char*>(_map) + _mapSize;
+  }
+
+  // copy a mapped index into private memory before it is modified
+  void detach() {
+    if (!_map)
+      return;
+    copy_array();
+    _key.own();
+    munmap(_map, _mapSize);
+    _map = nullptr;
+    _mapSize = 0;
+  }
+
+  // The position at or after cur where the scan looks up the trie next: a
+  // UTF-8 character start (0 always counts) at which, with a Teddy
+  // prefilter, some key may begin.
+  size_t nextStart(const char* str, size_t len, size_t cur) const {
+    if (!_teddy) {
+      while (cur && cur < len && (str[cur] & 0xC0) == 0x80)
+        ++cur;
+      return cur;
+    }
+    while (cur < len) {
+      cur = _teddy->find(str, len, cur);
+      if (cur >= len || cur == 0 || (str[cur] & 0xC0) != 0x80)
+        return cur;
+      ++cur;
+    }
+    return cur;
+  }
+
+  // whether a key may start at cur when every position is visited; next
+  // caches the next Teddy candidate and starts at 0
+  bool mayStart(const char* str, size_t len, size_t cur, size_t& next) const {
+    if (!_teddy)
+      return true;
+    if (next < cur)
+      next = _teddy->find(str, len, cur);
+    return next == cur;
+  }
+
+  // append the id, start and length columns of the matches of text to col
+  void appendColumns(text_ref text, bool longest, MatchColumns& col) const {
+    const char* str = text.data();
+    size_t last = 0, idx = 0;
+    auto visit = [&](int id, size_t start, size_t length) {
+      idx += charCount(str + last, start - last);
+      last = start;
+      col.id.push_back(id);
+      col.start.push_back(static_cast<int32_t>(idx));
+      col.length.push_back(charCount(str + start, length));
+    };
+    if (longest)
+      forEachLongestMatch(text, visit);
+    else
+      forEachMatch(text, visit);
+  }
+
+  // replay commonPrefixSearch at cur from the sorted automaton matches
+  size_t acPrefixSearch(const vector<ACMatch>& m, size_t& k, size_t cur,
+      trie::result_pair_type* result, size_t result_len, bool overwrite = false) const {
+    while (k < m.size() && m[k].start < cur)
+      ++k;
+    size_t num = 0;
+    for (size_t i = k; i < m.size() && m[i].start == cur && num < result_len; ++i) {
+      trie::result_pair_type& r = overwrite ? *result : result[num];
+      r.value = m[i].value;
+      r.length = m[i].length;
+      ++num;
+    }
+    return num;
+  }
+
   size_t _size = 0;
-  vector<string> _key;
+  KeyTable _key;
+  vector<int> _leaf;      // value node of every id with compact keys
+  bool _compact = false;
+  StartTable _start;
+  unique_ptr<ACAutomaton> _ac;
+  unique_ptr<Teddy> _teddy;
+  unique_ptr<StaticTrie> _frozen;
+  shared_ptr<const FastMatch> _base;  // the version under a layer()
+  vector<int> _removed;               // sorted ids of _base removed in the layer
+  size_t _first = 0;                  // id of _key[0]: the size of _base
+  void* _map = nullptr;
+  size_t _mapSize = 0;
 };
 
 #endif
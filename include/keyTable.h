@@ -0,0 +1,197 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef KEY_TABLE_H
+#define KEY_TABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Keys packed back to back in one byte arena, addressed by id through an
+// offset array. The table either owns its storage or is a read-only view
+// over external memory such as a mapped index file.
+class KeyTable {
+  public:
+  KeyTable() : _offset(1, 0) {}
+  KeyTable(const std::vector<std::string>& key) : _offset(1, 0) {
+    size_t bytes = 0;
+    for (auto& k : key)
+      bytes += k.size();
+    reserve(key.size(), bytes);
+    for (auto& k : key)
+      push_back(k.data(), k.size());
+  }
+
+  KeyTable(const KeyTable& other) { *this = other; }
+  KeyTable& operator=(const KeyTable& other) {
+    _bytes = other._bytes;
+    _offset = other._offset;
+    _n = other._n;
+    if (other.mapped()) {
+      _poffset = other._poffset;
+      _pbytes = other._pbytes;
+    } else {
+      sync();
+    }
+    return *this;
+  }
+
+  size_t size() const { return _n; }
+  size_t bytes() const { return _poffset[_n]; }
+  bool mapped() const { return _poffset != _offset.data(); }
+  // bytes allocated, or viewed when mapped
+  size_t memoryUsage() const {
+    return mapped() ? bytes() + (_n + 1) * sizeof(uint32_t) :
+                      _bytes.capacity() + _offset.capacity() * sizeof(uint32_t);
+  }
+
+  const char* data(size_t i) const { return _pbytes + _poffset[i]; }
+  size_t length(size_t i) const { return _poffset[i + 1] - _poffset[i]; }
+  std::string operator[](size_t i) const { return std::string(data(i), length(i)); }
+
+  // raw arrays, as written to an index file
+  const uint32_t* offsets() const { return _poffset; }
+  const char* arena() const { return _pbytes; }
+
+  void reserve(size_t n, size_t bytes = 0) {
+    own();
+    _offset.reserve(n + 1);
+    if (bytes)
+      _bytes.reserve(bytes);
+    sync();
+  }
+
+  void push_back(const char* key, size_t len) {
+    own();
+    if (_bytes.size() + len > UINT32_MAX) {
+      std::cerr << "Key table exceeds 4 GB!\n";
+      exit(EXIT_FAILURE);
+    }
+    _bytes.insert(_bytes.end(), key, key + len);
+    _offset.push_back(static_cast<uint32_t>(_bytes.size()));
+    ++_n;
+    sync();
+  }
+  void push_back(const std::string& key) { push_back(key.data(), key.size()); }
+
+  // whether n + 1 offsets address keys inside an arena of bytes bytes:
+  // they start at 0, never decrease and end at bytes
+  static bool valid(const uint32_t* offset, size_t n, size_t bytes) {
+    if (offset[0] != 0 || offset[n] != bytes)
+      return false;
+    for (size_t i = 0; i < n; ++i)
+      if (offset[i] > offset[i + 1])
+        return false;
+    return true;
+  }
+
+  // view n keys stored elsewhere; offset holds n + 1 entries
+  void attach(const uint32_t* offset, const char* bytes, size_t n) {
+    _bytes.clear();
+    _offset.assign(1, 0);
+    _poffset = offset;
+    _pbytes = bytes;
+    _n = n;
+  }
+
+  void clear() {
+    _bytes.clear();
+    _offset.assign(1, 0);
+    _n = 0;
+    sync();
+  }
+
+  void shrink() {
+    if (mapped())
+      return;
+    _bytes.shrink_to_fit();
+    _offset.shrink_to_fit();
+    sync();
+  }
+
+  // copy an attached view into owned storage before modifying it
+  void own() {
+    if (_poffset == _offset.data())
+      return;
+    std::vector<uint32_t> offset(_poffset, _poffset + _n + 1);
+    std::vector<char> bytes(_pbytes, _pbytes + _poffset[_n]);
+    _offset.swap(offset);
+    _bytes.swap(bytes);
+    sync();
+  }
+  private:
+  void sync() {
+    _poffset = _offset.data();
+    _pbytes = _bytes.data();
+  }
+
+  std::vector<char> _bytes;
+  std::vector<uint32_t> _offset;
+  const uint32_t* _poffset = _offset.data();
+  const char* _pbytes = _bytes.data();
+  size_t _n = 0;
+};
+
+// a key and its value, input of the trie builders
+struct KeyEntry {
+  const char* key;
+  size_t length;
+  int value;
+};
+
+inline int CompareKeys(const KeyEntry& a, const KeyEntry& b) {
+  int res = memcmp(a.key, b.key, std::min(a.length, b.length));
+  return res ? res : a.length < b.length ? -1 : a.length > b.length;
+}
+
+// the first 8 key bytes, big-endian and zero padded: keys in this order
+// are in key order, and keys with equal prefixes are compared in full
+inline uint64_t KeyPrefix(const KeyEntry& e) {
+  uint64_t res = 0;
+  for (size_t i = 0; i < 8; ++i)
+    res = res << 8 | (i < e.length ? static_cast<unsigned char>(e.key[i]) : 0);
+  return res;
+}
+
+// sort entries by key bytes, unless they already are; of equal keys the
+// last one is kept
+inline void SortKeys(std::vector<KeyEntry>& entry) {
+  auto less = [](const KeyEntry& a, const KeyEntry& b) { return CompareKeys(a, b) < 0; };
+  if (!std::is_sorted(entry.begin(), entry.end(), less)) {
+    // sort prefixes and positions rather than chase the key pointers
+    std::vector<std::pair<uint64_t, size_t>> order(entry.size());
+    for (size_t i = 0; i < entry.size(); ++i)
+      order[i] = std::make_pair(KeyPrefix(entry[i]), i);
+    std::sort(order.begin(), order.end(), [&](const std::pair<uint64_t, size_t>& a,
+                                              const std::pair<uint64_t, size_t>& b) {
+      if (a.first != b.first)
+        return a.first < b.first;
+      int res = CompareKeys(entry[a.second], entry[b.second]);
+      return res ? res < 0 : a.second < b.second;
+    });
+    std::vector<KeyEntry> sorted(entry.size());
+    for (size_t i = 0; i < order.size(); ++i)
+      sorted[i] = entry[order[i].second];
+    entry.swap(sorted);
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < entry.size(); ++i) {
+    if (n && CompareKeys(entry[n - 1], entry[i]) == 0)
+      --n;
+    entry[n++] = entry[i];
+  }
+  entry.resize(n);
+}
+
+#endif
@@ -0,0 +1,190 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// The NUMA nodes of the machine, read from /sys/devices/system/node, with
+// the CPUs this process may run on. Memory placement calls set_mempolicy,
+// get_mempolicy and mbind directly, so libnuma is not needed. Without NUMA
+// support, or where the calls are not permitted (as in many containers),
+// there is a single node and memory lands where it is first touched.
+
+#define MPOL_PREFERRED_MODE 1
+#define MPOL_BIND_MODE 2
+#define MPOL_F_NODE_FLAG 1
+#define MPOL_F_ADDR_FLAG 2
+#define MPOL_MF_MOVE_FLAG 2
+#define maxNumaNodes 1024
+
+struct NumaNode {
+  int id;                 // kernel node number
+  std::vector<int> cpus;  // the CPUs of the node this process may use
+};
+
+// "0-3,8,10-11" as a list of numbers
+inline std::vector<int> ParseCpuList(const std::string& s) {
+  std::vector<int> res;
+  size_t pos = 0;
+  while (pos < s.size()) {
+    size_t end = s.find(',', pos);
+    if (end == std::string::npos)
+      end = s.size();
+    std::string range = s.substr(pos, end - pos);
+    size_t dash = range.find('-');
+    if (range.find_first_of("0123456789") != std::string::npos) {
+      int lo = std::stoi(range);
+      int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+      for (int c = lo; c <= hi; ++c)
+        res.push_back(c);
+    }
+    pos = end + 1;
+  }
+  return res;
+}
+
+// The nodes with allowed CPUs, in node order; one node with all allowed
+// CPUs when the topology is unknown. Read once.
+inline const std::vector<NumaNode>& NumaNodes() {
+  static const std::vector<NumaNode> nodes = [] {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+      for (int c = 0; c < CPU_SETSIZE; ++c)
+        CPU_SET(c, &allowed);
+    std::vector<NumaNode> res;
+    std::string online;
+    std::ifstream in("/sys/devices/system/node/online");
+    if (getline(in, online))
+      for (int id : ParseCpuList(online)) {
+        std::ifstream list("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+        std::string cpus;
+        NumaNode node{id, {}};
+        if (getline(list, cpus))
+          for (int c : ParseCpuList(cpus))
+            if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed))
+              node.cpus.push_back(c);
+        if (node.cpus.size())
+          res.push_back(node);
+      }
+    if (res.empty()) {
+      NumaNode node{0, {}};
+      for (int c = 0; c < CPU_SETSIZE; ++c)
+        if (CPU_ISSET(c, &allowed))
+          node.cpus.push_back(c);
+      res.push_back(node);
+    }
+    return res;
+  }();
+  return nodes;
+}
+
+// index in NumaNodes() of the node of cpu; 0 if it is not listed
+inline int NumaNodeOfCpu(int cpu) {
+  auto& nodes = NumaNodes();
+  for (size_t n = 0; n < nodes.size(); ++n)
+    for (int c : nodes[n].cpus)
+      if (c == cpu)
+        return static_cast<int>(n);
+  return 0;
+}
+
+// the node the calling thread was pinned to by PinWorker(), or -1
+inline int& PinnedNumaNode() {
+  static thread_local int node = -1;
+  return node;
+}
+
+// Pin the calling thread to one CPU: worker i goes to node i % nodes, and
+// the workers of a node take its CPUs in turn, so that any number of
+// workers is spread evenly over the sockets. Returns the node index.
+inline int PinWorker(int worker) {
+  auto& nodes = NumaNodes();
+  int n = worker % static_cast<int>(nodes.size());
+  auto& cpus = nodes[n].cpus;
+  int cpu = cpus[(worker / nodes.size()) % cpus.size()];
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  sched_setaffinity(0, sizeof(set), &set);
+  return PinnedNumaNode() = n;
+}
+
+// Pin the calling thread to all CPUs of node index n.
+inline void PinToNode(int n) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int c : NumaNodes()[n].cpus)
+    CPU_SET(c, &set);
+  sched_setaffinity(0, sizeof(set), &set);
+  PinnedNumaNode() = n;
+}
+
+// index in NumaNodes() of the node the calling thread runs on
+inline int CurrentNumaNode() {
+  int n = PinnedNumaNode();
+  if (n >= 0 || NumaNodes().size() == 1)
+    return n >= 0 ? n : 0;
+  int cpu = sched_getcpu();
+  return cpu < 0 ? 0 : NumaNodeOfCpu(cpu);
+}
+
+// Allocate the memory the calling thread touches first on node index n
+// where possible, elsewhere once it is full; false if not supported.
+inline bool PreferNumaNode(int n) {
+#ifdef __NR_set_mempolicy
+  unsigned long mask[maxNumaNodes / 64] = {0};
+  int id = NumaNodes()[n].id;
+  mask[id / 64] = 1UL << (id % 64);
+  return syscall(__NR_set_mempolicy, MPOL_PREFERRED_MODE, mask, maxNumaNodes + 1) == 0;
+#else
+  return false;
+#endif
+}
+
+// Move the whole pages of [p, p + bytes) to node index n; false if not
+// supported.
+inline bool BindToNumaNode(const void* p, size_t bytes, int n) {
+#ifdef __NR_mbind
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t lo = (reinterpret_cast<size_t>(p) + page - 1) & ~(page - 1);
+  size_t hi = (reinterpret_cast<size_t>(p) + bytes) & ~(page - 1);
+  if (hi <= lo)
+    return true;
+  unsigned long mask[maxNumaNodes / 64] = {0};
+  int id = NumaNodes()[n].id;
+  mask[id / 64] = 1UL << (id % 64);
+  return syscall(__NR_mbind, lo, hi - lo, MPOL_BIND_MODE, mask, maxNumaNodes + 1,
+                 MPOL_MF_MOVE_FLAG) == 0;
+#else
+  return false;
+#endif
+}
+
+// index in NumaNodes() of the node that holds the page of p, or -1
+inline int NumaNodeOfAddress(const void* p) {
+#ifdef __NR_get_mempolicy
+  int id = -1;
+  if (syscall(__NR_get_mempolicy, &id, nullptr, 0, p, MPOL_F_NODE_FLAG | MPOL_F_ADDR_FLAG) != 0)
+    return -1;
+  auto& nodes = NumaNodes();
+  for (size_t n = 0; n < nodes.size(); ++n)
+    if (nodes[n].id == id)
+      return static_cast<int>(n);
+#endif
+  return -1;
+}
+
+#endif
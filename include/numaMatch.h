@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef NUMA_MATCH_H
+#define NUMA_MATCH_H
+
+#include "fastMatch.h"
+#include "numa.h"
+
+// A read-only FastMatch with a replica on every NUMA node, for matching on
+// multi-socket machines. The batch methods pin their worker threads to
+// CPUs spread over the nodes, and every worker matches against the replica
+// of its own node, so trie and key accesses stay in local memory instead
+// of crossing the interconnect. A replica is a deep copy (trie, keys,
+// automaton, prefilter) made by a thread pinned to its node that prefers
+// the node's memory; the trie nodes are moved there if they landed
+// elsewhere. fm itself serves the node its trie lives on, and on a machine
+// with a single node no copy is made. fm must not change afterwards: take a
+// VersionedMatch snapshot or build a new NumaMatch after updates.
+class NumaMatch {
+  public:
+  explicit NumaMatch(shared_ptr<const FastMatch> fm) {
+    auto& nodes = NumaNodes();
+    _replica.resize(nodes.size());
+    int home = nodes.size() == 1 ? 0 : fm->frozen() ? -1 : NumaNodeOfAddress(fm->array());
+    vector<thread> threads;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+      if (static_cast<int>(n) == home) {
+        _replica[n] = fm;
+        continue;
+      }
+      threads.emplace_back([&, n] {
+        int node = static_cast<int>(n);
+        PinToNode(node);
+        PreferNumaNode(node);
+        shared_ptr<FastMatch> copy = make_shared<FastMatch>(*fm);
+        if (!copy->frozen())
+          BindToNumaNode(copy->array(), copy->array_size(), node);
+        _replica[n] = copy;
+      });
+    }
+    for (auto& t : threads)
+      t.join();
+  }
+
+  size_t numNodes() const { return _replica.size(); }
+
+  const FastMatch& replica(size_t node) const { return *_replica[node]; }
+
+  // the replica of the node the calling thread runs on
+  const FastMatch& local() const { return *_replica[CurrentNumaNode()]; }
+
+  // FastMatch::parse(), parseHit() and maxForwardMatch() over many texts,
+  // on pinned threads against their local replicas
+  void parse(const vector<string>& text, bool fast = false, int num_patterns = -1,
+      int num_threads = 0) const {
+    if (text.empty())
+      return;
+    if (num_threads <= 0)
+      num_threads = thread::hardware_concurrency();
+    auto func = [&](const string& str, string& out) {
+      local().formatParse(str, fast, num_patterns, out);
+    };
+    RunOrdered(text, func, num_threads, true);
+  }
+
+  void parseHit(const vector<string>& text, int num_threads = 0) const {
+    if (text.empty())
+      return;
+    if (num_threads <= 0)
+      num_threads = thread::hardware_concurrency();
+    auto func = [&](const string& str, string& out) {
+      local().formatHit(str, out);
+    };
+    RunOrdered(text, func, num_threads, true);
+  }
+
+  void maxForwardMatch(const vector<string>& text, int num_threads = 0) const {
+    if (text.empty())
+      return;
+    if (num_threads <= 0)
+      num_threads = thread::hardware_concurrency();
+    auto func = [&](const string& str, string& out) {
+      out.append(local().maxForwardMatchSingle(str));
+    };
+    RunOrdered(text, func, num_threads, true);
+  }
+
+  // streaming variants of the methods above
+  void parse(istream& in, bool fast = false, int num_patterns = -1,
+      int num_threads = 0, size_t batch_size = 0) const {
+    auto func = [&](const string& str, string& out) {
+      local().formatParse(str, fast, num_patterns, out);
+    };
+    RunPipeline(in, STDOUT_FILENO, func, num_threads, batch_size, true);
+  }
+
+  void parseHit(istream& in, int num_threads = 0, size_t batch_size = 0) const {
+    auto func = [&](const string& str, string& out) {
+      local().formatHit(str, out);
+    };
+    RunPipeline(in, STDOUT_FILENO, func, num_threads, batch_size, true);
+  }
+
+  void maxForwardMatch(istream& in, int num_threads = 0, size_t batch_size = 0) const {
+    auto func = [&](const string& str, string& out) {
+      out.append(local().maxForwardMatchSingle(str));
+    };
+    RunPipeline(in, STDOUT_FILENO, func, num_threads, batch_size, true);
+  }
+
+  // batch variants that return the result of every text
+  vector<int> hitBatch(const vector<string>& text, int num_threads = 0) const {
+    return RunBatch<int>(text, [&](const string& str) { return local().hit(str); },
+        num_threads, true);
+  }
+
+  vector<vector<pair<string, int>>> parseBatch(const vector<string>& text,
+      int num_threads = 0) const {
+    return RunBatch<vector<pair<string, int>>>(text,
+        [&](const string& str) { return local().parseBind(str); }, num_threads, true);
+  }
+
+  vector<vector<pair<string, int>>> parse2Batch(const vector<string>& text,
+      int num_threads = 0) const {
+    return RunBatch<vector<pair<string, int>>>(text,
+        [&](const string& str) { return local().parseBind2(str); }, num_threads, true);
+  }
+
+  vector<vector<string>> maxForwardMatchBatch(const vector<string>& text,
+      int num_threads = 0) const {
+    return RunBatch<vector<string>>(text,
+        [&](const string& str) { return local().maxForwardMatch(str); }, num_threads, true);
+  }
+
+  private:
+  vector<shared_ptr<const FastMatch>> _replica;  // by index in NumaNodes()
+};
+
+#endif
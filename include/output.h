@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#define outputBufferSize (1 << 20)
+
+// Write a list of buffers to fd with as few writev() calls as possible,
+// resuming after partial writes and EINTR.
+inline bool WriteBuffers(int fd, const std::vector<const std::string*>& bufs) {
+  std::vector<iovec> iov;
+  iov.reserve(bufs.size());
+  for (auto buf : bufs)
+    if (buf->size())
+      iov.push_back({const_cast<char*>(buf->data()), buf->size()});
+  size_t i = 0;
+  while (i < iov.size()) {
+    int cnt = static_cast<int>(std::min(iov.size() - i, static_cast<size_t>(IOV_MAX)));
+    ssize_t ret = writev(fd, &iov[i], cnt);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    size_t done = static_cast<size_t>(ret);
+    while (i < iov.size() && done >= iov[i].iov_len)
+      done -= iov[i++].iov_len;
+    if (done) {
+      iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + done;
+      iov[i].iov_len -= done;
+    }
+  }
+  return true;
+}
+
+inline bool WriteAll(int fd, const std::string& buf) {
+  return WriteBuffers(fd, std::vector<const std::string*>(1, &buf));
+}
+
+// Collects the output of disjoint ranges of texts [start, end) from many
+// threads and writes it to fd in text order. Whichever thread completes the
+// next pending range writes every range that became contiguous in one
+// writev() call while other threads keep formatting.
+class OrderedWriter {
+  public:
+  OrderedWriter(int fd = STDOUT_FILENO, size_t first = 0) : _fd(fd), _next(first) {}
+
+  // buf is taken over and left empty; empty ranges are ignored
+  void commit(size_t start, size_t end, std::string& buf) {
+    if (start == end)
+      return;
+    std::unique_lock<std::mutex> lock(_mutex);
+    _pending[start].first = end;
+    _pending[start].second.swap(buf);
+    if (_writing)
+      return;
+    _writing = true;
+    while (!_pending.empty() && _pending.begin()->first == _next) {
+      std::vector<std::string> ready;
+      for (auto it = _pending.begin(); it != _pending.end() && it->first == _next;
+           it = _pending.erase(it)) {
+        _next = it->second.first;
+        ready.emplace_back();
+        ready.back().swap(it->second.second);
+      }
+      lock.unlock();
+      std::vector<const std::string*> bufs;
+      for (auto& r : ready)
+        bufs.push_back(&r);
+      bool ok = !_failed && WriteBuffers(_fd, bufs);
+      lock.lock();
+      _failed = !ok;
+    }
+    _writing = false;
+  }
+
+  bool failed() const { return _failed; }
+
+  private:
+  int _fd;
+  size_t _next;
+  bool _writing = false;
+  bool _failed = false;
+  std::map<size_t, std::pair<size_t, std::string>> _pending;
+  std::mutex _mutex;
+};
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "numa.h"
+#include "output.h"
+
+#define defaultBatchSize 4096
+#define maxBatchBytes (4 << 20)
+
+template <typename T>
+class BoundedQueue {
+  public:
+  BoundedQueue(size_t capacity) : _capacity(capacity) {}
+
+  bool push(T&& item) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _notFull.wait(lock, [&] { return _queue.size() < _capacity || _closed; });
+    if (_closed)
+      return false;
+    _queue.push_back(std::move(item));
+    _notEmpty.notify_one();
+    return true;
+  }
+
+  // blocks until an item is available; false once closed and drained
+  bool pop(T& item) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _notEmpty.wait(lock, [&] { return !_queue.empty() || _closed; });
+    if (_queue.empty())
+      return false;
+    item = std::move(_queue.front());
+    _queue.pop_front();
+    _notFull.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+    _notEmpty.notify_all();
+    _notFull.notify_all();
+  }
+
+  private:
+  size_t _capacity;
+  bool _closed = false;
+  std::deque<T> _queue;
+  std::mutex _mutex;
+  std::condition_variable _notEmpty;
+  std::condition_variable _notFull;
+};
+
+struct LineBatch {
+  size_t id = 0;
+  std::vector<std::string> lines;
+  std::string out;
+};
+
+// Stream lines from in through num_threads workers and write the results
+// to fd in input order. A reader thread cuts the input into batches of at
+// most batch_size lines (or maxBatchBytes bytes) and at most 2 * num_threads
+// batches are in flight, so memory stays proportional to the batch size.
+// With pin, the workers are pinned to CPUs spread over the NUMA nodes.
+// Returns false if writing the output failed; the input is still drained.
+inline bool RunPipeline(std::istream& in, int fd,
+    std::function<void(const std::string&, std::string&)> func,
+    int num_threads = 0, size_t batch_size = 0, bool pin = false) {
+  if (num_threads <= 0)
+    num_threads = std::thread::hardware_concurrency();
+  if (batch_size == 0)
+    batch_size = defaultBatchSize;
+  std::cout.flush();
+  size_t window = 2 * static_cast<size_t>(num_threads);
+  BoundedQueue<LineBatch> input(window), output(window);
+  // batches read but not yet written
+  size_t inflight = 0;
+  std::mutex mutex;
+  std::condition_variable cond;
+
+  std::thread reader([&] {
+    for (size_t id = 0; in.good(); ++id) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] { return inflight < window; });
+        ++inflight;
+      }
+      LineBatch batch;
+      batch.id = id;
+      batch.lines.reserve(batch_size);
+      size_t bytes = 0;
+      std::string line;
+      while (batch.lines.size() < batch_size && bytes < maxBatchBytes &&
+             getline(in, line)) {
+        bytes += line.size();
+        batch.lines.emplace_back(std::move(line));
+      }
+      if (batch.lines.empty() || !input.push(std::move(batch))) {
+        std::lock_guard<std::mutex> lock(mutex);
+        --inflight;
+        break;
+      }
+    }
+    input.close();
+  });
+
+  std::atomic<int> active(num_threads);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < num_threads; ++i) {
+    workers.emplace_back([&, i] {
+      if (pin)
+        PinWorker(i);
+      LineBatch batch;
+      while (input.pop(batch)) {
+        batch.out.clear();
+        for (auto& line : batch.lines)
+          func(line, batch.out);
+        std::vector<std::string>().swap(batch.lines);
+        output.push(std::move(batch));
+      }
+      if (--active == 0)
+        output.close();
+    });
+  }
+
+  // the calling thread writes the batches back in input order, all
+  // contiguous finished batches with one writev()
+  std::map<size_t, std::string> pending;
+  size_t next = 0;
+  bool ok = true;
+  LineBatch batch;
+  while (output.pop(batch)) {
+    pending[batch.id].swap(batch.out);
+    std::vector<const std::string*> bufs;
+    auto it = pending.begin();
+    for (; it != pending.end() && it->first == next; ++it, ++next)
+      bufs.push_back(&it->second);
+    if (bufs.empty())
+      continue;
+    ok = ok && WriteBuffers(fd, bufs);
+    pending.erase(pending.begin(), it);
+    std::lock_guard<std::mutex> lock(mutex);
+    inflight -= bufs.size();
+    cond.notify_one();
+  }
+  reader.join();
+  for (auto& t : workers)
+    t.join();
+  return ok;
+}
+
+#endif
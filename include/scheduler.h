@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "numa.h"
+
+#define chunksPerThread 16
+#define minChunkBytes (64 << 10)
+
+// Cut texts into contiguous chunks of roughly equal byte size, about
+// chunksPerThread chunks per thread. A chunk holds at least one text, so a
+// very long text simply ends up alone in its chunk.
+inline std::vector<size_t> ChunkBounds(const std::vector<std::string>& text, int num_threads) {
+  size_t n = text.size(), total = 0;
+  for (auto& s : text)
+    total += s.size() + 1;
+  size_t target = total / (static_cast<size_t>(std::max(num_threads, 1)) * chunksPerThread);
+  target = std::max(target, static_cast<size_t>(minChunkBytes));
+  std::vector<size_t> bounds(1, 0);
+  size_t bytes = 0;
+  for (size_t i = 0; i < n; ++i) {
+    bytes += text[i].size() + 1;
+    if (bytes >= target) {
+      bounds.push_back(i + 1);
+      bytes = 0;
+    }
+  }
+  if (bounds.back() != n)
+    bounds.push_back(n);
+  return bounds;
+}
+
+// Run func(start, end) over the chunks [bounds[c], bounds[c + 1]) on
+// num_threads threads. Chunks are handed out in order from a shared counter,
+// so a thread that finishes early takes over the remaining work. With pin,
+// the threads are pinned to CPUs spread over the NUMA nodes (PinWorker());
+// OpenMP threads are placed by OMP_PROC_BIND and OMP_PLACES instead.
+inline void RunChunked(std::function<void(size_t, size_t)> func, const std::vector<size_t>& bounds,
+    int num_threads, bool pin = false) {
+  size_t num = bounds.size() - 1;
+  if (num == 0)
+    return;
+  num_threads = static_cast<int>(std::min(static_cast<size_t>(std::max(num_threads, 1)), num));
+#ifdef USE_OMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+  for (size_t c = 0; c < num; ++c)
+    func(bounds[c], bounds[c + 1]);
+#else
+  std::atomic<size_t> next(0);
+  auto worker = [&](int i) {
+    if (pin)
+      PinWorker(i);
+    for (size_t c = next++; c < num; c = next++)
+      func(bounds[c], bounds[c + 1]);
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(static_cast<size_t>(num_threads));
+  for (int i = 0; i < num_threads; ++i)
+    threads.emplace_back(worker, i);
+  for (auto& t : threads)
+    t.join();
+#endif
+}
+
+#endif
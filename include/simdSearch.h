@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef SIMD_SEARCH_H
+#define SIMD_SEARCH_H
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Length-bounded substring search. Text and pattern may contain NUL bytes.
+// Blocks of candidate positions are filtered by comparing the first and the
+// last byte of the pattern at once (32 positions with AVX2, 16 with SSE2),
+// and only the survivors are verified with memcmp().
+
+inline const char* ScalarSearch(const char* text, size_t n, const char* pattern, size_t m) {
+  if (m == 0 || n < m)
+    return nullptr;
+  const char* end = text + n - m + 1;
+  for (const char* p = text; p < end; ++p) {
+    p = static_cast<const char*>(memchr(p, pattern[0], end - p));
+    if (p == nullptr)
+      return nullptr;
+    if (memcmp(p + 1, pattern + 1, m - 1) == 0)
+      return p;
+  }
+  return nullptr;
+}
+
+#if defined(__AVX2__)
+// positions i..i+31 whose first and last pattern bytes match
+inline unsigned CandidateMask32(const char* text, size_t i, size_t m, __m256i first, __m256i last) {
+  __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+  __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + m - 1));
+  return static_cast<unsigned>(_mm256_movemask_epi8(
+      _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+}
+#endif
+
+#if defined(__SSE2__)
+inline unsigned CandidateMask16(const char* text, size_t i, size_t m, __m128i first, __m128i last) {
+  __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+  __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + m - 1));
+  return static_cast<unsigned>(_mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+}
+#endif
+
+// verify the candidates of the block at i
+inline const char* VerifyCandidates(const char* text, size_t i, unsigned mask,
+    const char* pattern, size_t m) {
+  while (mask) {
+    unsigned bit = __builtin_ctz(mask);
+    if (memcmp(text + i + bit + 1, pattern + 1, m - 2) == 0)
+      return text + i + bit;
+    mask &= mask - 1;
+  }
+  return nullptr;
+}
+
+// First occurrence of pattern in text, or nullptr. The last partial block
+// is handled by one more block overlapping the previous one, so scalar code
+// only runs on texts shorter than a vector.
+inline const char* SimdSearch(const char* text, size_t n, const char* pattern, size_t m) {
+  if (m == 0 || n < m)
+    return nullptr;
+  if (m == 1)
+    return static_cast<const char*>(memchr(text, pattern[0], n));
+  // number of candidate positions
+  size_t count = n - m + 1;
+  const char* res = nullptr;
+#if defined(__AVX2__)
+  if (count >= 32) {
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[m - 1]);
+    size_t i = 0;
+    for (; i + 64 <= count; i += 64) {
+      unsigned lo = CandidateMask32(text, i, m, first, last);
+      unsigned hi = CandidateMask32(text, i + 32, m, first, last);
+      if ((lo | hi) == 0)
+        continue;
+      if ((res = VerifyCandidates(text, i, lo, pattern, m)) ||
+          (res = VerifyCandidates(text, i + 32, hi, pattern, m)))
+        return res;
+    }
+    for (; i + 32 <= count; i += 32)
+      if ((res = VerifyCandidates(text, i, CandidateMask32(text, i, m, first, last), pattern, m)))
+        return res;
+    if (i < count) {
+      size_t j = count - 32;
+      unsigned mask = CandidateMask32(text, j, m, first, last) & (~0u << (i - j));
+      return VerifyCandidates(text, j, mask, pattern, m);
+    }
+    return nullptr;
+  }
+#endif
+#if defined(__SSE2__)
+  if (count >= 16) {
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[m - 1]);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+      if ((res = VerifyCandidates(text, i, CandidateMask16(text, i, m, first, last), pattern, m)))
+        return res;
+    if (i < count) {
+      size_t j = count - 16;
+      unsigned mask = CandidateMask16(text, j, m, first, last) & (~0u << (i - j));
+      return VerifyCandidates(text, j, mask, pattern, m);
+    }
+    return nullptr;
+  }
+#endif
+  return ScalarSearch(text, n, pattern, m);
+}
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef START_TABLE_H
+#define START_TABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Which first bytes and byte pairs can begin a key, with the trie nodes
+// they lead to. A bit set answers the common "no key starts here" case from
+// L1 cache; the node array, indexed by the byte pair, is only read on a hit.
+// Nodes are remembered by slot so that they can be followed when the trie
+// relocates them.
+class StartTable {
+  public:
+  StartTable() : _node(65536, -1) { reset(); }
+
+  void reset() {
+    memset(_first, 0, sizeof(_first));
+    memset(_short, 0, sizeof(_short));
+    memset(_pair, 0, sizeof(_pair));
+    memset(_pairKey, 0, sizeof(_pairKey));
+    std::fill(_node.begin(), _node.end(), -1);
+    std::fill(_firstNode, _firstNode + 256, -1);
+    _slot.clear();
+  }
+
+  // bytes held, with an estimate of the hash map nodes
+  size_t memoryUsage() const {
+    return sizeof(*this) + _node.capacity() * sizeof(int) + _slot.bucket_count() * sizeof(void*) +
+           _slot.size() * (sizeof(std::pair<const int, unsigned>) + sizeof(void*));
+  }
+
+  // some key starts with byte c
+  bool first(unsigned char c) const { return test(_first, c); }
+  // a one-byte key c exists
+  bool shortKey(unsigned char c) const { return test(_short, c); }
+  int firstNode(unsigned char c) const { return _firstNode[c]; }
+  // node reached by the byte pair b = c0 << 8 | c1, or -1
+  int node(unsigned b) const { return test(_pair, b) ? _node[b] : -1; }
+  // the two-byte key b exists
+  bool pairKey(unsigned b) const { return test(_pairKey, b); }
+
+  void setFirst(unsigned char c, int node, bool shortKey) {
+    assign(_first, c, node >= 0);
+    assign(_short, c, shortKey);
+    rekey(_firstNode[c], node, firstSlot + c);
+    _firstNode[c] = node;
+  }
+
+  void setPair(unsigned b, int node, bool pairKey) {
+    assign(_pair, b, node >= 0);
+    assign(_pairKey, b, pairKey);
+    rekey(_node[b], node, b);
+    _node[b] = node;
+  }
+
+  // the trie moved node from to to
+  void move(int from, int to) {
+    auto it = _slot.find(from);
+    if (it == _slot.end())
+      return;
+    unsigned slot = it->second;
+    _slot.erase(it);
+    _slot[to] = slot;
+    if (slot >= firstSlot)
+      _firstNode[slot - firstSlot] = to;
+    else
+      _node[slot] = to;
+  }
+
+  private:
+  static const unsigned firstSlot = 65536;
+
+  static bool test(const uint64_t* bits, unsigned i) { return (bits[i >> 6] >> (i & 63)) & 1; }
+  static void assign(uint64_t* bits, unsigned i, bool on) {
+    if (on)
+      bits[i >> 6] |= uint64_t(1) << (i & 63);
+    else
+      bits[i >> 6] &= ~(uint64_t(1) << (i & 63));
+  }
+
+  // the root (0) never moves and may stand for several slots
+  void rekey(int from, int to, unsigned slot) {
+    if (from == to)
+      return;
+    if (from > 0)
+      _slot.erase(from);
+    if (to > 0)
+      _slot[to] = slot;
+  }
+
+  uint64_t _first[4];
+  uint64_t _short[4];
+  uint64_t _pair[1024];
+  uint64_t _pairKey[1024];
+  int _firstNode[256];
+  std::vector<int> _node;
+  std::unordered_map<int, unsigned> _slot;  // node -> slot
+};
+
+#endif
@@ -0,0 +1,240 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef STATIC_TRIE_H
+#define STATIC_TRIE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "keyTable.h"
+
+// A read-only double array in the darts-clone layout: one 32-bit unit per
+// node holds its label, a has-leaf flag and the offset to its children,
+// which sit at node ^ offset ^ label. The value of a key is kept in a leaf
+// unit at node ^ offset (label 0). No two nodes share node ^ offset, so a
+// child is verified by its label alone. Built once from sorted keys, it
+// takes 4 bytes per node where cedar::da takes 8 plus its ninfo and block
+// bookkeeping and spare capacity. The lookup methods mirror those of
+// cedar::da and return the same results.
+class StaticTrie {
+  public:
+  enum error_code { noValue = -1, noPath = -2 };
+
+  StaticTrie() : _unit(256, emptyUnit), _keys(0) { _unit[0] = 0; }
+
+  size_t size() const { return _unit.size(); }
+  size_t total_size() const { return _unit.size() * sizeof(uint32_t); }
+  size_t num_keys() const { return _keys; }
+
+  // Build from entries, which are sorted here; of equal keys the last one
+  // is kept. Keys must be non-empty without NUL bytes and values in
+  // [0, 2^31). Returns -1 if the array outgrows the 2^29 offsets a unit
+  // can encode.
+  int build(std::vector<KeyEntry>& entry) {
+    SortKeys(entry);
+    size_t n = entry.size();
+    _unit.assign(256, emptyUnit);
+    _unit[0] = 0;
+    _keys = n;
+    Builder b(_unit);
+    b.use(0);
+    // depth-first, as darts-clone, so that children stay close to their
+    // parent and most offsets fit the short encoding
+    struct Range {
+      uint32_t node;
+      size_t lo, hi, depth;
+    };
+    std::vector<Range> stack;
+    if (n)
+      stack.push_back({0, 0, n, 0});
+    std::vector<unsigned char> label;
+    std::vector<Range> child;
+    while (stack.size()) {
+      Range r = stack.back();
+      stack.pop_back();
+      label.clear();
+      child.clear();
+      int value = -1;
+      size_t lo = r.lo;
+      if (entry[lo].length == r.depth) {
+        value = entry[lo].value;
+        label.push_back(0);
+        ++lo;
+      }
+      while (lo < r.hi) {
+        unsigned char c = static_cast<unsigned char>(entry[lo].key[r.depth]);
+        size_t hi = lo + 1;
+        while (hi < r.hi && static_cast<unsigned char>(entry[hi].key[r.depth]) == c)
+          ++hi;
+        label.push_back(c);
+        child.push_back({0, lo, hi, r.depth + 1});
+        lo = hi;
+      }
+      uint32_t base = b.find(r.node, label);
+      uint32_t offset = r.node ^ base;
+      if (offset >= (1u << 29))
+        return -1;
+      _unit[r.node] |= (offset < (1u << 21) ? offset << 10 : (offset << 2) | (1u << 9)) |
+                       (value >= 0 ? 1u << 8 : 0);
+      for (size_t i = 0; i < label.size(); ++i) {
+        uint32_t to = base ^ label[i];
+        b.use(to);
+        _unit[to] = label[i] ? label[i] : leafFlag | static_cast<uint32_t>(value);
+      }
+      for (size_t i = child.size(); i--;) {
+        child[i].node = base ^ label[label.size() - child.size() + i];
+        stack.push_back(child[i]);
+      }
+    }
+    _unit.shrink_to_fit();
+    return 0;
+  }
+
+  template <typename T>
+  T exactMatchSearch(const char* key, size_t len, size_t from = 0) const {
+    size_t pos = 0;
+    int value = traverse(key, from, pos, len);
+    return value == noPath ? noValue : value;
+  }
+
+  // follow key[pos, len) from node from as cedar::da::traverse(): from and
+  // pos stop at the last node reached
+  int traverse(const char* key, size_t& from, size_t& pos, size_t len) const {
+    uint32_t unit = _unit[from];
+    for (; pos < len; ++pos) {
+      unsigned char c = static_cast<unsigned char>(key[pos]);
+      size_t to = from ^ offset(unit) ^ c;
+      uint32_t next = _unit[to];
+      if (label(next) != c)
+        return noPath;
+      from = to;
+      unit = next;
+    }
+    return hasLeaf(unit) ? static_cast<int>(_unit[from ^ offset(unit)] & ~leafFlag) : noValue;
+  }
+
+  // every key that is a prefix of key[0, len), below node from
+  template <typename T>
+  size_t commonPrefixSearch(const char* key, T* result, size_t result_len, size_t len,
+      size_t from = 0) const {
+    size_t num = 0;
+    uint32_t unit = _unit[from];
+    for (size_t pos = 0; pos < len && num < result_len; ++pos) {
+      unsigned char c = static_cast<unsigned char>(key[pos]);
+      from ^= offset(unit) ^ c;
+      unit = _unit[from];
+      if (label(unit) != c)
+        break;
+      if (hasLeaf(unit)) {
+        result[num].value = static_cast<int>(_unit[from ^ offset(unit)] & ~leafFlag);
+        result[num].length = pos + 1;
+        ++num;
+      }
+    }
+    return num;
+  }
+
+  // as above, keeping only the longest match in *result
+  template <typename T>
+  size_t commonPrefixSearch(const char* key, size_t len, T* result, size_t result_len,
+      size_t from = 0) const {
+    size_t num = 0;
+    uint32_t unit = _unit[from];
+    for (size_t pos = 0; pos < len && num < result_len; ++pos) {
+      unsigned char c = static_cast<unsigned char>(key[pos]);
+      from ^= offset(unit) ^ c;
+      unit = _unit[from];
+      if (label(unit) != c)
+        break;
+      if (hasLeaf(unit)) {
+        result->value = static_cast<int>(_unit[from ^ offset(unit)] & ~leafFlag);
+        result->length = pos + 1;
+        ++num;
+      }
+    }
+    return num;
+  }
+
+  private:
+  // a leaf unit holds a value below this flag; unused units are leaf units
+  // too, so that no label, not even a NUL byte, reaches them
+  enum : uint32_t { leafFlag = 1u << 31, emptyUnit = leafFlag };
+
+  static uint32_t label(uint32_t unit) { return unit & (leafFlag | 0xFF); }
+  static bool hasLeaf(uint32_t unit) { return (unit >> 8) & 1; }
+  static uint32_t offset(uint32_t unit) { return (unit >> 10) << ((unit & (1u << 9)) >> 6); }
+
+  // free slot bookkeeping of build(), dropped afterwards
+  struct Builder {
+    std::vector<uint32_t>& unit;
+    std::vector<bool> used;      // slot holds a node
+    std::vector<bool> usedBase;  // some node has its children at base ^ label
+    std::vector<uint32_t> skip;  // next possibly free slot at or after i
+
+    Builder(std::vector<uint32_t>& u) : unit(u), used(u.size()), usedBase(u.size()),
+        skip(u.size()) {
+      for (size_t i = 0; i < skip.size(); ++i)
+        skip[i] = static_cast<uint32_t>(i);
+    }
+
+    uint32_t nextFree(uint32_t i) {
+      uint32_t res = i;
+      while (res < skip.size() && skip[res] != res)
+        res = skip[res];
+      while (i != res) {
+        uint32_t next = skip[i];
+        skip[i] = res;
+        i = next;
+      }
+      return res;
+    }
+
+    void use(uint32_t i) {
+      used[i] = true;
+      skip[i] = i + 1;
+    }
+
+    // A base for the children labels of node: every base ^ label free and
+    // the base not taken. Only the last 16 blocks of 256 slots are searched,
+    // as in darts-clone; otherwise a new block is added with the base
+    // aligned to node so that the offset fits the long encoding.
+    uint32_t find(uint32_t node, const std::vector<unsigned char>& label) {
+      uint32_t size = static_cast<uint32_t>(unit.size());
+      uint32_t start = size > openSlots ? size - openSlots : 0;
+      for (uint32_t f = nextFree(start); f < size; f = nextFree(f + 1)) {
+        uint32_t base = f ^ label[0];
+        uint32_t offset = node ^ base;
+        if (usedBase[base] || (offset >= (1u << 21) && (offset & 0xFF)))
+          continue;
+        bool ok = true;
+        for (size_t i = 1; i < label.size() && ok; ++i)
+          ok = !used[base ^ label[i]];
+        if (ok) {
+          usedBase[base] = true;
+          return base;
+        }
+      }
+      unit.resize(size + 256, emptyUnit);
+      used.resize(size + 256);
+      usedBase.resize(size + 256);
+      for (uint32_t i = size; i < size + 256; ++i)
+        skip.push_back(i);
+      uint32_t base = size | (node & 0xFF);
+      usedBase[base] = true;
+      return base;
+    }
+
+    enum : uint32_t { openSlots = 16 * 256 };
+  };
+
+  std::vector<uint32_t> _unit;
+  size_t _keys;
+};
+
+#endif
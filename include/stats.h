@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+// Stage timings and throughput counters of a CLI run (--stats). Stages are
+// timed in wall and process CPU time; the matching threads count the texts
+// they handle and their busy time through wrap().
+class Stats {
+  public:
+  struct Stage {
+    std::string name;
+    double wall = 0;
+    double cpu = 0;
+  };
+
+  struct Thread {
+    double busy = 0;
+    size_t lines = 0;
+    size_t bytes = 0;
+    size_t matches = 0;
+    size_t output = 0;
+  };
+
+  // count(text, out) returns the number of matches a func call appended to out
+  typedef std::function<void(const std::string&, std::string&)> Func;
+  typedef std::function<size_t(const std::string&, const char*, size_t)> Counter;
+
+  Stats() : _start(Clock::now()), _cpu(cpuSeconds()) { _last = _start; _lastCpu = _cpu; }
+
+  // close the current stage under name
+  void stage(const std::string& name) {
+    Clock::time_point now = Clock::now();
+    double cpu = cpuSeconds();
+    Stage s;
+    s.name = name;
+    s.wall = seconds(_last, now);
+    s.cpu = cpu - _lastCpu;
+    _stage.push_back(s);
+    _last = now;
+    _lastCpu = cpu;
+  }
+
+  // func with the texts, bytes, matches and busy time of every call counted
+  // for the calling thread
+  Func wrap(Func func, Counter count) {
+    return [this, func, count](const std::string& text, std::string& out) {
+      Thread& t = thread();
+      Clock::time_point t0 = Clock::now();
+      size_t before = out.size();
+      func(text, out);
+      t.busy += seconds(t0, Clock::now());
+      ++t.lines;
+      t.bytes += text.size() + 1;
+      t.output += out.size() - before;
+      if (out.size() > before)
+        t.matches += count(text, out.data() + before, out.size() - before);
+    };
+  }
+
+  void print(FILE* f) const {
+    Thread total = sum();
+    double wall = seconds(_start, _last);
+    fprintf(f, "%-12s %10s %10s\n", "stage", "wall s", "cpu s");
+    for (auto& s : _stage)
+      fprintf(f, "%-12s %10.3f %10.3f\n", s.name.c_str(), s.wall, s.cpu);
+    fprintf(f, "%-12s %10.3f %10.3f\n", "total", wall, _lastCpu - _cpu);
+    fprintf(f, "lines %zu, bytes %zu (%.1f MB/s), matches %zu, output bytes %zu\n", total.lines,
+            total.bytes, wall > 0 ? total.bytes / wall / 1048576 : 0.0, total.matches,
+            total.output);
+    fprintf(f, "threads %zu, busy min/mean/max %.3f / %.3f / %.3f s, imbalance %.2f\n",
+            _thread.size(), minBusy(), meanBusy(), maxBusy(), imbalance());
+    fprintf(f, "peak rss %.1f MB\n", peakRss() / 1024.0);
+  }
+
+  bool writeJson(const std::string& path) const {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+      return false;
+    Thread total = sum();
+    fprintf(f, "{\n  \"stages\": [");
+    for (size_t i = 0; i < _stage.size(); ++i)
+      fprintf(f, "%s\n    {\"name\": \"%s\", \"wall\": %.6f, \"cpu\": %.6f}", i ? "," : "",
+              _stage[i].name.c_str(), _stage[i].wall, _stage[i].cpu);
+    fprintf(f, "\n  ],\n  \"wall\": %.6f,\n  \"cpu\": %.6f,\n", seconds(_start, _last),
+            _lastCpu - _cpu);
+    fprintf(f, "  \"lines\": %zu,\n  \"bytes\": %zu,\n  \"matches\": %zu,\n"
+            "  \"output_bytes\": %zu,\n", total.lines, total.bytes, total.matches, total.output);
+    fprintf(f, "  \"thread_busy\": [");
+    for (size_t i = 0; i < _thread.size(); ++i)
+      fprintf(f, "%s%.6f", i ? ", " : "", _thread[i].busy);
+    fprintf(f, "],\n  \"imbalance\": %.4f,\n  \"peak_rss_kb\": %ld\n}\n", imbalance(), peakRss());
+    return fclose(f) == 0;
+  }
+
+  private:
+  typedef std::chrono::steady_clock Clock;
+
+  static double seconds(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double>(b - a).count();
+  }
+
+  static double cpuSeconds() {
+    struct rusage r;
+    getrusage(RUSAGE_SELF, &r);
+    return r.ru_utime.tv_sec + r.ru_stime.tv_sec +
+           (r.ru_utime.tv_usec + r.ru_stime.tv_usec) * 1e-6;
+  }
+
+  static long peakRss() {
+    struct rusage r;
+    getrusage(RUSAGE_SELF, &r);
+    return r.ru_maxrss;
+  }
+
+  // the record of the calling thread, registered on first use
+  Thread& thread() {
+    thread_local const Stats* owner = nullptr;
+    thread_local Thread* record = nullptr;
+    if (owner != this) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _thread.emplace_back();
+      record = &_thread.back();
+      owner = this;
+    }
+    return *record;
+  }
+
+  Thread sum() const {
+    Thread total;
+    for (auto& t : _thread) {
+      total.busy += t.busy;
+      total.lines += t.lines;
+      total.bytes += t.bytes;
+      total.matches += t.matches;
+      total.output += t.output;
+    }
+    return total;
+  }
+
+  double minBusy() const {
+    double res = _thread.empty() ? 0 : _thread.front().busy;
+    for (auto& t : _thread)
+      res = std::min(res, t.busy);
+    return res;
+  }
+  double maxBusy() const {
+    double res = 0;
+    for (auto& t : _thread)
+      res = std::max(res, t.busy);
+    return res;
+  }
+  double meanBusy() const { return _thread.empty() ? 0 : sum().busy / _thread.size(); }
+  // max over mean busy time: 1 when the threads are evenly loaded
+  double imbalance() const { return meanBusy() > 0 ? maxBusy() / meanBusy() : 1; }
+
+  Clock::time_point _start, _last;
+  double _cpu, _lastCpu;
+  std::vector<Stage> _stage;
+  std::deque<Thread> _thread;  // stable addresses for the thread records
+  std::mutex _mutex;
+};
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef TEDDY_H
+#define TEDDY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+#define maxTeddyWidth 3
+#define numTeddyBuckets 8
+
+// Teddy-style packed prefilter for small key sets. The distinct prefixes of
+// the first width bytes of the keys are split into 8 buckets, and for each
+// prefix byte two 16-entry tables map its low and high nibble to the set of
+// buckets having that nibble there. A position can start a key only if some
+// bucket survives the AND of the lookups of all prefix bytes, which pshufb
+// evaluates for 32 (AVX2) or 16 (SSSE3) positions at once.
+class Teddy {
+  public:
+  Teddy() { clear(); }
+
+  // keys must not be empty
+  void build(const std::vector<std::string>& keys) {
+    clear();
+    if (keys.empty())
+      return;
+    size_t width = maxTeddyWidth;
+    for (auto& k : keys)
+      width = std::min(width, k.size());
+    if (width == 0)
+      return;
+    std::vector<std::string> prefix;
+    prefix.reserve(keys.size());
+    for (auto& k : keys)
+      prefix.emplace_back(k, 0, width);
+    std::sort(prefix.begin(), prefix.end());
+    prefix.erase(std::unique(prefix.begin(), prefix.end()), prefix.end());
+    // neighbouring prefixes share a bucket, which keeps false positives low
+    for (size_t i = 0; i < prefix.size(); ++i) {
+      uint8_t bucket = static_cast<uint8_t>(1 << (i * numTeddyBuckets / prefix.size()));
+      for (size_t j = 0; j < width; ++j) {
+        unsigned char c = static_cast<unsigned char>(prefix[i][j]);
+        _lo[j][c & 0x0F] |= bucket;
+        _hi[j][c >> 4] |= bucket;
+      }
+    }
+    // the AVX2 shuffle works on two 16-byte lanes
+    for (size_t j = 0; j < width; ++j) {
+      memcpy(_lo[j] + 16, _lo[j], 16);
+      memcpy(_hi[j] + 16, _hi[j], 16);
+    }
+    _width = width;
+  }
+
+  void clear() {
+    memset(_lo, 0, sizeof(_lo));
+    memset(_hi, 0, sizeof(_hi));
+    _width = 0;
+  }
+
+  bool empty() const { return _width == 0; }
+  size_t width() const { return _width; }
+
+  // first position from from on where a key may start, or len
+  size_t find(const char* str, size_t len, size_t from) const {
+    if (empty() || len < _width)
+      return len;
+    size_t end = len - _width + 1, i = from;
+#if defined(__AVX2__)
+    if (end >= 32) {
+      __m256i lo[maxTeddyWidth], hi[maxTeddyWidth];
+      for (size_t j = 0; j < _width; ++j) {
+        lo[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_lo[j]));
+        hi[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_hi[j]));
+      }
+      for (; i + 32 <= end; i += 32) {
+        unsigned mask = blockMask(str + i, lo, hi);
+        if (mask)
+          return i + __builtin_ctz(mask);
+      }
+      // the remaining positions in one block overlapping the previous one
+      if (i < end) {
+        size_t j = end - 32;
+        unsigned mask = blockMask(str + j, lo, hi) & (~0u << (i - j));
+        if (mask)
+          return j + __builtin_ctz(mask);
+      }
+      return len;
+    }
+#elif defined(__SSSE3__)
+    if (end >= 16) {
+      __m128i lo[maxTeddyWidth], hi[maxTeddyWidth];
+      for (size_t j = 0; j < _width; ++j) {
+        lo[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_lo[j]));
+        hi[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_hi[j]));
+      }
+      for (; i + 16 <= end; i += 16) {
+        unsigned mask = blockMask(str + i, lo, hi);
+        if (mask)
+          return i + __builtin_ctz(mask);
+      }
+      if (i < end) {
+        size_t j = end - 16;
+        unsigned mask = blockMask(str + j, lo, hi) & (~0u << (i - j));
+        if (mask)
+          return j + __builtin_ctz(mask);
+      }
+      return len;
+    }
+#endif
+    for (; i < end; ++i) {
+      uint8_t res = 0xFF;
+      for (size_t j = 0; j < _width && res; ++j) {
+        unsigned char c = static_cast<unsigned char>(str[i + j]);
+        res &= _lo[j][c & 0x0F] & _hi[j][c >> 4];
+      }
+      if (res)
+        return i;
+    }
+    return len;
+  }
+
+  private:
+  // positions of the block at str where some bucket survives
+#if defined(__AVX2__)
+  unsigned blockMask(const char* str, const __m256i* lo, const __m256i* hi) const {
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    __m256i res = _mm256_set1_epi8(-1);
+    for (size_t j = 0; j < _width; ++j) {
+      __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + j));
+      __m256i a = _mm256_shuffle_epi8(lo[j], _mm256_and_si256(t, low));
+      __m256i b = _mm256_shuffle_epi8(hi[j], _mm256_and_si256(_mm256_srli_epi16(t, 4), low));
+      res = _mm256_and_si256(res, _mm256_and_si256(a, b));
+    }
+    return ~static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(res, _mm256_setzero_si256())));
+  }
+#elif defined(__SSSE3__)
+  unsigned blockMask(const char* str, const __m128i* lo, const __m128i* hi) const {
+    const __m128i low = _mm_set1_epi8(0x0F);
+    __m128i res = _mm_set1_epi8(-1);
+    for (size_t j = 0; j < _width; ++j) {
+      __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + j));
+      __m128i a = _mm_shuffle_epi8(lo[j], _mm_and_si128(t, low));
+      __m128i b = _mm_shuffle_epi8(hi[j], _mm_and_si128(_mm_srli_epi16(t, 4), low));
+      res = _mm_and_si128(res, _mm_and_si128(a, b));
+    }
+    return ~static_cast<unsigned>(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(res, _mm_setzero_si128()))) & 0xFFFF;
+  }
+#endif
+
+  uint8_t _lo[maxTeddyWidth][32];
+  uint8_t _hi[maxTeddyWidth][32];
+  size_t _width;
+};
+
+#endif
@@ -0,0 +1,468 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef TRIE_BUILDER_H
+#define TRIE_BUILDER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "keyTable.h"
+
+// Builds the arrays of a cedar::da from sorted keys in one pass, level by
+// level, instead of inserting the keys one at a time with update(). The
+// children of a node are placed together at the first base where all their
+// slots are free, searching the last 16 blocks of 256 slots. The nodes
+// below each first byte are built into their own blocks, so the subtrees
+// can be built on several threads and the array is the same for any number
+// of threads. Empty slots are linked into the per-block free lists of
+// cedar and the labels of siblings are recorded as in its ninfo, so that
+// cedar only restores its block records and the trie takes updates
+// afterwards. Trie is a cedar::da; the arrays are allocated in its pages.
+template <class Trie>
+class TrieBuilder {
+  public:
+  typedef typename Trie::node Node;
+  typedef typename Trie::ninfo Info;
+
+  // Build trie from entries (sorted here, keys non-empty without NUL bytes).
+  static void build(std::vector<KeyEntry>& entry, Trie& trie, int num_threads = 1) {
+    SortKeys(entry);
+    // every level reads a byte of each key; with the keys copied back to
+    // back in sorted order those reads stream through memory
+    size_t bytes = 0;
+    for (auto& e : entry)
+      bytes += e.length;
+    std::vector<char> arena(bytes);
+    bytes = 0;
+    for (auto& e : entry) {
+      memcpy(arena.data() + bytes, e.key, e.length);
+      e.key = arena.data() + bytes;
+      bytes += e.length;
+    }
+    // the subtrees below each first byte
+    std::vector<Part> part;
+    for (size_t lo = 0; lo < entry.size();) {
+      unsigned char c = static_cast<unsigned char>(entry[lo].key[0]);
+      size_t hi = lo + 1;
+      while (hi < entry.size() && static_cast<unsigned char>(entry[hi].key[0]) == c)
+        ++hi;
+      part.emplace_back(c, lo, hi);
+      lo = hi;
+    }
+    if (num_threads <= 0)
+      num_threads = std::thread::hardware_concurrency();
+    num_threads = static_cast<int>(std::min<size_t>(num_threads, part.size()));
+
+    // block 0 holds the root, with base 0, and the first bytes; the parts
+    // follow in the order of their first bytes
+    Store s;
+    s.pages = trie.pages();
+    s.grow();
+    if (num_threads <= 1) {
+      for (auto& p : part)
+        p.build(entry, s, p.first);
+    } else {
+      // the largest parts first, each into a store of its own that is then
+      // moved behind the others
+      std::vector<Store> local(part.size());
+      std::vector<size_t> order(part.size());
+      for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+      std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return part[a].hi - part[a].lo > part[b].hi - part[b].lo;
+      });
+      std::atomic<size_t> next(0);
+      auto run = [&]() {
+        for (size_t i; (i = next++) < order.size();)
+          part[order[i]].build(entry, local[order[i]], -1);
+      };
+      std::vector<std::thread> threads;
+      for (int i = 1; i < num_threads; ++i)
+        threads.emplace_back(run);
+      run();
+      for (auto& t : threads)
+        t.join();
+      for (size_t i = 0; i < part.size(); ++i) {
+        s.append(local[i], part[i]);
+        local[i].release();
+      }
+    }
+    s.node[0] = Node(0, -1);
+    s.markUsed(0);
+    // as in cedar, the root is its own child with label 0 and the first
+    // bytes follow it as siblings; erase() relies on that sibling
+    if (part.size())
+      s.info[0].sibling = part[0].first;
+    for (size_t k = 0; k < part.size(); ++k) {
+      Part& p = part[k];
+      s.node[p.first] = Node(p.base, 0);
+      s.info[p.first].child = p.child;
+      s.info[p.first].sibling = k + 1 < part.size() ? part[k + 1].first : 0;
+      s.markUsed(p.first);
+    }
+    finish(s, trie);
+  }
+
+  // Rebuild trie, which holds the keys of entry, with its nodes renumbered
+  // for cache locality. The children of the nodes are placed in the order
+  // in which a breadth-first walk over the whole trie reaches the nodes, so
+  // that the upper levels every search passes through share few cache lines
+  // and pages; build() and update() interleave them with deeper nodes of
+  // their own subtree. With visits, the number of searches through every
+  // node of trie, nodes are taken hottest first instead (ties breadth
+  // first), which packs the hot paths of all levels at the front.
+  static void relayout(std::vector<KeyEntry>& entry, Trie& trie,
+                       const std::vector<uint32_t>* visits = nullptr) {
+    SortKeys(entry);
+    const Node* old = static_cast<const Node*>(trie.array());
+    Store s;
+    s.pages = trie.pages();
+    s.grow();
+    s.node[0] = Node(0, -1);
+    s.markUsed(0);
+    --s.num[0];
+    // the root keeps base 0, so the first bytes stay in block 0
+    std::priority_queue<Range, std::vector<Range>, Colder> heap;
+    std::deque<Range> fifo;
+    uint64_t seq = 0;
+    auto push = [&](const Range& r) {
+      if (visits)
+        heap.push(r);
+      else
+        fifo.push_back(r);
+    };
+    unsigned char last = 0;
+    for (size_t lo = 0; lo < entry.size();) {
+      unsigned char c = static_cast<unsigned char>(entry[lo].key[0]);
+      size_t hi = lo + 1;
+      while (hi < entry.size() && static_cast<unsigned char>(entry[hi].key[0]) == c)
+        ++hi;
+      s.node[c] = Node(0, 0);
+      s.markUsed(c);
+      --s.num[0];
+      // the first bytes follow the root's own label-0 entry, as in build()
+      s.info[last].sibling = c;
+      last = c;
+      push(Range{c, c, static_cast<uint32_t>(lo), static_cast<uint32_t>(hi), 1,
+                 visits ? (*visits)[c] : 0, seq++});
+      lo = hi;
+    }
+    // the other nodes go to blocks of their own, as in build(): with deep
+    // nodes in block 0, cedar could not move the first bytes aside to make
+    // room for a new one
+    Part p(0, 0, entry.size());
+    p.open = s.num.size();
+    std::vector<unsigned char> label;
+    std::vector<Range> child;
+    while (visits ? !heap.empty() : !fifo.empty()) {
+      Range r = visits ? heap.top() : fifo.front();
+      if (visits)
+        heap.pop();
+      else
+        fifo.pop_front();
+      label.clear();
+      child.clear();
+      uint32_t i = r.lo;
+      if (entry[i].length == r.depth) {
+        label.push_back(0);
+        ++i;
+      }
+      while (i < r.hi) {
+        unsigned char c = static_cast<unsigned char>(entry[i].key[r.depth]);
+        label.push_back(c);
+        uint32_t j = i + 1;
+        while (j < r.hi && static_cast<unsigned char>(entry[j].key[r.depth]) == c)
+          ++j;
+        child.push_back(Range{0, 0, i, j, r.depth + 1, 0, 0});
+        i = j;
+      }
+      int b = p.place(s, r.node, label.data(), label.size(), entry[r.lo].value);
+      for (size_t c = 0; c < child.size(); ++c) {
+        Range& ch = child[c];
+        unsigned char l = label[label.size() - child.size() + c];
+        ch.node = b ^ l;
+        if (visits) {
+          ch.old = old[r.old].base_ ^ l;
+          ch.weight = (*visits)[ch.old];
+        }
+        ch.seq = seq++;
+        if (ch.hi - ch.lo > 1)
+          push(ch);
+        else
+          p.chain(s, ch.node, entry[ch.lo], ch.depth);
+      }
+    }
+    finish(s, trie);
+  }
+
+  private:
+  struct Part;
+
+  // a node to place the children of: the keys [lo, hi) below it, at depth;
+  // old is the node in the trie being relaid out and weight its visits
+  struct Range {
+    int node, old;
+    uint32_t lo, hi, depth;
+    uint32_t weight;
+    uint64_t seq;
+  };
+
+  // orders a priority queue hottest first, then in breadth-first order
+  struct Colder {
+    bool operator()(const Range& a, const Range& b) const {
+      return a.weight != b.weight ? a.weight < b.weight : a.seq > b.seq;
+    }
+  };
+
+  // nodes and ninfo records, allocated in pages for cedar to take over, and
+  // the free slots of every block
+  struct Store {
+    Node* node = nullptr;
+    Info* info = nullptr;
+    typename Trie::page_type pages = Trie::SMALL_PAGES;
+    std::vector<bool> value;        // the node holds a value (label 0)
+    std::vector<uint64_t> free;     // free slots, 4 words per block
+    std::vector<uint16_t> num;      // free slots per block
+    std::vector<uint16_t> reject;   // fewest labels that did not fit a block
+    size_t size = 0;
+    size_t capacity = 0;
+
+    Store() {}
+    Store(const Store&) = delete;
+    Store& operator=(const Store&) = delete;
+    ~Store() { release(); }
+
+    void release() {
+      Trie::free_pages(node);
+      Trie::free_pages(info);
+      node = nullptr;
+      info = nullptr;
+      value = std::vector<bool>();
+      free = std::vector<uint64_t>();
+      num = std::vector<uint16_t>();
+      reject = std::vector<uint16_t>();
+      size = capacity = 0;
+    }
+
+    bool isFree(size_t i) const { return (free[i >> 6] >> (i & 63)) & 1; }
+    void markUsed(size_t i) { free[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+
+    void reserve(size_t n) {
+      if (n <= capacity)
+        return;
+      capacity = std::max(n, capacity * 2);
+      Node* p = static_cast<Node*>(Trie::realloc_pages(node, sizeof(Node) * capacity, pages));
+      if (p)
+        node = p;
+      Info* q = static_cast<Info*>(Trie::realloc_pages(info, sizeof(Info) * capacity, pages));
+      if (q)
+        info = q;
+      if (!p || !q) {
+        std::cerr << "Failed to allocate the trie!\n";
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    void shrink() {
+      if (Node* p = static_cast<Node*>(Trie::realloc_pages(node, sizeof(Node) * size, pages)))
+        node = p;
+      if (Info* q = static_cast<Info*>(Trie::realloc_pages(info, sizeof(Info) * size, pages)))
+        info = q;
+      capacity = size;
+    }
+
+    // add an empty block
+    void grow() {
+      reserve(size + 256);
+      std::fill(node + size, node + size + 256, Node());
+      std::fill(info + size, info + size + 256, Info());
+      value.resize(size + 256);
+      free.resize((size + 256) >> 6, ~uint64_t(0));
+      num.push_back(256);
+      reject.push_back(257);
+      size += 256;
+    }
+
+    // move the nodes of p, built into from, behind ours
+    void append(const Store& from, Part& p) {
+      reserve(size + from.size);
+      int shift = static_cast<int>(size);
+      for (size_t i = 0; i < from.size; ++i) {
+        const Node& n = from.node[i];
+        node[size + i] = from.isFree(i) ? Node() :
+            Node(from.value[i] ? n.base_ : n.base_ + shift,
+                 n.check < 0 ? static_cast<int>(p.first) : n.check + shift);
+      }
+      std::copy(from.info, from.info + from.size, info + size);
+      value.resize(size + from.size);
+      free.insert(free.end(), from.free.begin(), from.free.end());
+      num.insert(num.end(), from.num.begin(), from.num.end());
+      reject.insert(reject.end(), from.reject.begin(), from.reject.end());
+      size += from.size;
+      p.base += shift;
+    }
+  };
+
+  // link the empty slots, trim the store and hand it over to trie
+  static void finish(Store& s, Trie& trie) {
+    // empty slots of a block form a cyclic list: base_ = -prev, check = -next
+    std::vector<int> empty;
+    for (size_t b = 0; b < s.size; b += 256) {
+      empty.clear();
+      for (size_t k = 0; k < 4; ++k)
+        for (uint64_t bits = s.free[(b >> 6) + k]; bits; bits &= bits - 1)
+          empty.push_back(static_cast<int>(b + k * 64 + __builtin_ctzll(bits)));
+      for (size_t k = 0; k < empty.size(); ++k) {
+        int prev = empty[(k + empty.size() - 1) % empty.size()];
+        int next = empty[(k + 1) % empty.size()];
+        s.node[empty[k]] = Node(-prev, -next);
+      }
+    }
+    s.shrink();
+    trie.adopt_array(s.node, s.size, s.info);
+    s.node = nullptr;
+    s.info = nullptr;
+  }
+
+  // the nodes below first byte first, placed behind those of a store; base
+  // is the base of the children of the depth-1 node and child their first
+  // label
+  struct Part {
+    unsigned char first;
+    uint32_t lo, hi;
+    int base = 0;
+    unsigned char child = 0;
+    int top = -1;     // check of the children of the depth-1 node
+    size_t open = 0;  // first block searched: blocks before it are full, out
+                      // of the window or of other parts
+
+    Part(unsigned char c, size_t l, size_t h)
+        : first(c), lo(static_cast<uint32_t>(l)), hi(static_cast<uint32_t>(h)) {}
+
+    // build into s, with check for the children of the depth-1 node: its
+    // index, or -1 if s is to be appended to another store
+    void build(const std::vector<KeyEntry>& entry, Store& s, int check) {
+      struct Range {
+        int node;
+        uint32_t lo, hi, depth;
+      };
+      top = check;
+      open = s.num.size();
+      std::vector<Range> level(1, Range{-1, lo, hi, 1}), next, child;
+      std::vector<unsigned char> label;
+      while (level.size()) {
+        next.clear();
+        for (auto& r : level) {
+          label.clear();
+          child.clear();
+          uint32_t k = r.lo, i = r.lo;
+          if (entry[k].length == r.depth) {
+            label.push_back(0);
+            ++i;
+          }
+          while (i < r.hi) {
+            unsigned char c = static_cast<unsigned char>(entry[i].key[r.depth]);
+            label.push_back(c);
+            uint32_t j = i + 1;
+            while (j < r.hi && static_cast<unsigned char>(entry[j].key[r.depth]) == c)
+              ++j;
+            child.push_back(Range{0, i, j, r.depth + 1});
+            i = j;
+          }
+          int b = place(s, r.node, label.data(), label.size(), entry[k].value);
+          for (size_t c = 0; c < child.size(); ++c) {
+            Range& ch = child[c];
+            ch.node = b ^ label[label.size() - child.size() + c];
+            if (ch.hi - ch.lo > 1)
+              next.push_back(ch);
+            else
+              chain(s, ch.node, entry[ch.lo], ch.depth);
+          }
+        }
+        level.swap(next);
+      }
+    }
+
+    // place the children label[0, n) of node (-1: the depth-1 node); label
+    // 0 holds value. Returns their base.
+    int place(Store& s, int parent, const unsigned char* label, size_t n, int v) {
+      int b = find(s, label, n);
+      if (parent < 0) {
+        base = b;
+        child = label[0];
+      } else {
+        s.node[parent].base_ = b;
+        s.info[parent].child = label[0];
+      }
+      for (size_t i = 0; i < n; ++i) {
+        int to = b ^ label[i];
+        s.markUsed(to);
+        --s.num[to >> 8];
+        s.node[to] = Node(label[i] ? 0 : v, parent < 0 ? top : parent);
+        s.info[to].sibling = i + 1 < n ? label[i + 1] : 0;
+        if (!label[i])
+          s.value[to] = true;
+      }
+      return b;
+    }
+
+    // the rest of the only key below node, from byte depth on, one node per
+    // byte; most nodes of a large dictionary are on such chains
+    void chain(Store& s, int from, const KeyEntry& e, size_t depth) {
+      for (; depth < e.length; ++depth) {
+        unsigned char c = static_cast<unsigned char>(e.key[depth]);
+        from = place(s, from, &c, 1, 0) ^ c;
+      }
+      unsigned char c = 0;
+      place(s, from, &c, 1, e.value);
+    }
+
+    // A base with every base ^ label free, in the last 16 blocks or in a
+    // new one. As in cedar, a block is skipped for as many labels as
+    // once failed to fit it.
+    int find(Store& s, const unsigned char* label, size_t n) {
+      if (open + 16 < s.num.size())
+        open = s.num.size() - 16;
+      while (open < s.num.size() && !s.num[open])
+        ++open;
+      for (size_t b = open << 8; b < s.size; b += 256) {
+        const uint64_t* w = &s.free[b >> 6];
+        uint16_t& r = s.reject[b >> 8];
+        if (n >= r)
+          continue;
+        if (s.num[b >> 8] < n) {
+          r = static_cast<uint16_t>(n);
+          continue;
+        }
+        for (size_t k = 0; k < 4; ++k)
+          for (uint64_t bits = w[k]; bits; bits &= bits - 1) {
+            size_t base = (b + k * 64 + __builtin_ctzll(bits)) ^ label[0];
+            bool ok = true;
+            for (size_t i = 1; i < n && ok; ++i)
+              ok = s.isFree(base ^ label[i]);
+            if (ok)
+              return static_cast<int>(base);
+          }
+        r = static_cast<uint16_t>(n);
+      }
+      s.grow();
+      return static_cast<int>(s.size - 256);
+    }
+  };
+};
+
+#endif
@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) 2023-present, Zejun Wang.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef VERSIONED_MATCH_H
+#define VERSIONED_MATCH_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include "fastMatch.h"
+
+// what reload() changed and where its time went
+struct ReloadStats {
+  size_t added = 0;
+  size_t removed = 0;
+  double read_seconds = 0;   // reading the key file
+  double diff_seconds = 0;   // finding the added and removed keys
+  double apply_seconds = 0;  // applying the delta to a new version
+};
+
+// A FastMatch that takes key updates while other threads keep matching.
+// Readers pin the current version with snapshot() and match against it
+// without any lock. Writers build the next version privately and publish it
+// atomically; a version is freed when the last snapshot holding it is
+// released. insert(), remove() and reload() publish a FastMatch::layer()
+// over the trie and keys of the current version, so they cost about the
+// size of the change in time and memory. Once the layer has grown to an
+// eighth of the dictionary, the next change merges it into a flat copy,
+// which for a frozen version is rebuilt once with FastMatch::apply().
+// update() edits a flat deep copy of the current version, which may thaw a
+// frozen one; it is frozen again. The automaton or Teddy prefilter of the
+// current version is rebuilt for the new one.
+class VersionedMatch {
+  public:
+  VersionedMatch() : _current(make_shared<const FastMatch>()) {}
+  VersionedMatch(const string& filename, size_t capacity = 0)
+      : _current(make_shared<const FastMatch>(filename, capacity)) {}
+  VersionedMatch(const vector<string>& key) : _current(make_shared<const FastMatch>(key)) {}
+
+  shared_ptr<const FastMatch> snapshot() const { return atomic_load(&_current); }
+  size_t version() const { return _version.load(); }
+
+  // apply edit to a copy of the current version and publish the result
+  void update(function<void(FastMatch&)> edit) {
+    lock_guard<mutex> lock(_writer);
+    publish(edit);
+  }
+
+  void insert(const vector<string>& key) {
+    lock_guard<mutex> lock(_writer);
+    change(vector<string>(), key);
+  }
+
+  void remove(const vector<string>& key) {
+    lock_guard<mutex> lock(_writer);
+    change(key, vector<string>());
+  }
+
+  // Bring the keys in line with a regenerated key file. Only the keys added
+  // to or removed from the file are applied, as by insert() and remove():
+  // reading and comparing the file follow its size, publishing the new
+  // version the size of the change. Nothing is published when the file is
+  // unchanged. Returns -1 if the file cannot be read.
+  int reload(const string& filename, ReloadStats* stats = nullptr) {
+    typedef chrono::steady_clock Clock;
+    auto seconds = [](Clock::time_point a, Clock::time_point b) {
+      return chrono::duration<double>(b - a).count();
+    };
+    ReloadStats res;
+    auto t0 = Clock::now();
+    ifstream in(filename);
+    if (!in.is_open())
+      return -1;
+    vector<string> key;
+    string line;
+    while (getline(in, line))
+      if (line.size())
+        key.push_back(line);
+    auto t1 = Clock::now();
+    lock_guard<mutex> lock(_writer);
+    shared_ptr<const FastMatch> cur = snapshot();
+    // keys of the file are looked up in the current trie; ids not seen are
+    // removed unless already dead
+    vector<string> added, removed;
+    vector<bool> seen(cur->size(), false);
+    for (auto& k : key) {
+      int id = cur->getValue(k);
+      if (id < 0)
+        added.push_back(k);
+      else
+        seen[id] = true;
+    }
+    sort(added.begin(), added.end());
+    added.erase(unique(added.begin(), added.end()), added.end());
+    for (size_t i = 0; i < cur->size(); ++i) {
+      if (seen[i])
+        continue;
+      string k = cur->getKey(static_cast<int>(i));
+      if (cur->getValue(k) == static_cast<int>(i))
+        removed.push_back(k);
+    }
+    auto t2 = Clock::now();
+    if (added.size() || removed.size())
+      change(removed, added);
+    auto t3 = Clock::now();
+    res.added = added.size();
+    res.removed = removed.size();
+    res.read_seconds = seconds(t0, t1);
+    res.diff_seconds = seconds(t1, t2);
+    res.apply_seconds = seconds(t2, t3);
+    if (stats)
+      *stats = res;
+    return 0;
+  }
+
+  private:
+  // apply edit to a flat copy of the current version and publish it; the
+  // caller holds _writer
+  void publish(function<void(FastMatch&)> edit) {
+    shared_ptr<const FastMatch> cur = snapshot();
+    shared_ptr<FastMatch> next = make_shared<FastMatch>(*cur);
+    bool frozen = next->frozen();
+    edit(*next);
+    if (frozen)
+      next->freeze();
+    store(*cur, std::move(next));
+  }
+
+  // publish the current version with the keys removed and added, in a
+  // layer while it stays small; the caller holds _writer
+  void change(const vector<string>& removed, const vector<string>& added) {
+    shared_ptr<const FastMatch> cur = snapshot();
+    if ((cur->layerSize() + removed.size() + added.size()) * 8 > cur->size()) {
+      publish([&](FastMatch& fm) { fm.apply(removed, added); });
+      return;
+    }
+    shared_ptr<FastMatch> next = FastMatch::layer(cur);
+    next->apply(removed, added);
+    store(*cur, std::move(next));
+  }
+
+  // give next the prefilter of cur back and make it the current version
+  void store(const FastMatch& cur, shared_ptr<FastMatch> next) {
+    if (cur.hasAutomaton() && !next->hasAutomaton())
+      next->buildAutomaton();
+    else if (cur.hasTeddy() && !next->hasTeddy())
+      next->buildTeddy();
+    atomic_store(&_current, shared_ptr<const FastMatch>(std::move(next)));
+    ++_version;
+  }
+
+  shared_ptr<const FastMatch> _current;
+  atomic<size_t> _version{0};
+  mutex _writer;  // serializes writers
+};
+
+#endif
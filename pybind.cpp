@@ -7,8 +7,12 @@
  */
 
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl_bind.h>
 #include <pybind11/stl.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <fastMatch.h>
 
 namespace py = pybind11;
@@ -19,24 +23,185 @@ using SEG = vector<string>;
 PYBIND11_MAKE_OPAQUE(MATCH);
 PYBIND11_MAKE_OPAQUE(SEG);
 
+// hand the vector over to a NumPy array without copying
+template <typename T>
+py::array_t<T> ToArray(vector<T>&& v) {
+  auto* p = new vector<T>(std::move(v));
+  py::capsule owner(p, [](void* q) { delete static_cast<vector<T>*>(q); });
+  return py::array_t<T>(p->size(), p->data(), owner);
+}
+
+py::dict ToDict(MatchColumns&& col) {
+  py::dict res;
+  res["id"] = ToArray(std::move(col.id));
+  res["start"] = ToArray(std::move(col.start));
+  res["length"] = ToArray(std::move(col.length));
+  res["text"] = ToArray(std::move(col.text));
+  res["offset"] = ToArray(std::move(col.offset));
+  return res;
+}
+
+py::dict ToDict(const MemoryUsage& usage) {
+  py::dict res;
+  res["nodes"] = usage.nodes;
+  res["tail"] = usage.tail;
+  res["ninfo"] = usage.ninfo;
+  res["blocks"] = usage.blocks;
+  res["frozen"] = usage.frozen;
+  res["keys"] = usage.keys;
+  res["start"] = usage.start;
+  res["automaton"] = usage.automaton;
+  res["teddy"] = usage.teddy;
+  res["mapped"] = usage.mapped;
+  res["huge"] = usage.huge;
+  res["total"] = usage.total();
+  return res;
+}
+
+// A reader-writer lock in C++11: any number of readers or one writer.
+// Readers only increment and decrement an atomic counter, so concurrent
+// matches never queue on a mutex. A writer holds the mutex for the whole
+// write and raises a flag that keeps new readers out, so updates are not
+// starved by a steady stream of matches; it waits for the readers inside to
+// leave, and readers that find the flag up sleep on the mutex until it is
+// released.
+class RWLock {
+  public:
+  void lockShared() {
+    for (;;) {
+      while (_writer.load())
+        lock_guard<mutex> wait(_mutex);
+      ++_readers;
+      if (!_writer.load())
+        return;
+      --_readers;
+    }
+  }
+
+  void unlockShared() { --_readers; }
+
+  void lock() {
+    _mutex.lock();
+    _writer.store(true);
+    while (_readers.load() != 0)
+      this_thread::yield();
+  }
+
+  void unlock() {
+    _writer.store(false);
+    _mutex.unlock();
+  }
+
+  private:
+  mutex _mutex;  // held by the writer
+  atomic<size_t> _readers{0};
+  atomic<bool> _writer{false};
+};
+
+// FastMatch guarded by a reader-writer lock. The matching methods are
+// const and keep no shared scratch state, so they run with the GIL released
+// and concurrently under the shared lock; methods that change the keys take
+// the lock exclusively.
+class SharedFastMatch : public FastMatch {
+  public:
+  using FastMatch::FastMatch;
+  mutable RWLock lock;
+};
+
+template <typename F>
+auto Read(const SharedFastMatch& fm, F f) -> decltype(f()) {
+  py::gil_scoped_release release;
+  fm.lock.lockShared();
+  struct Unlock {
+    RWLock& lock;
+    ~Unlock() { lock.unlockShared(); }
+  } unlock{fm.lock};
+  return f();
+}
+
+template <typename F>
+auto Write(SharedFastMatch& fm, F f) -> decltype(f()) {
+  py::gil_scoped_release release;
+  lock_guard<RWLock> lock(fm.lock);
+  return f();
+}
+
+// wrap the method f of FastMatch (or of the trie) to run under Read()
+template <typename Ret, typename Class, typename... Args>
+function<Ret(const SharedFastMatch&, Args...)> Reader(Ret (Class::*f)(Args...) const) {
+  return [f](const SharedFastMatch& fm, Args... args) {
+    return Read(fm, [&] { return (fm.*f)(args...); });
+  };
+}
+
+template <typename Ret, typename Class, typename... Args>
+function<Ret(SharedFastMatch&, Args...)> Writer(Ret (Class::*f)(Args...)) {
+  return [f](SharedFastMatch& fm, Args... args) {
+    return Write(fm, [&] { return (fm.*f)(args...); });
+  };
+}
+
 PYBIND11_MODULE(fast_match, m) {
   m.doc() = "Efficient exact string matching tool";
   py::bind_vector<MATCH>(m, "MATCH");
   py::bind_vector<SEG>(m, "SEG");
-  py::class_<FastMatch>(m, "FastMatch")
+  py::enum_<trie::page_type>(m, "PageType")
+    .value("SMALL_PAGES", trie::SMALL_PAGES)
+    .value("HUGE_PAGES", trie::HUGE_PAGES)
+    .value("HUGETLB_PAGES", trie::HUGETLB_PAGES)
+    .export_values();
+  py::class_<SharedFastMatch>(m, "FastMatch")
     .def(py::init())
-    .def(py::init<const string&, size_t>(), py::arg("path"), py::arg("capacity") = 0)
-    .def(py::init<const vector<string>&>(), py::arg("key"))
-    .def("size", &FastMatch::size)
-    .def("num_keys", &FastMatch::num_keys)
-    .def("insert", &FastMatch::insert, py::arg("key"))
-    .def("remove", &FastMatch::remove, py::arg("key"))
-    .def("get_key", &FastMatch::getKey, py::arg("id"))
-    .def("get_value", &FastMatch::getValue, py::arg("key"))
-    .def("hit", &FastMatch::hit, py::arg("text"))
-    .def("parse", &FastMatch::parseBind, py::arg("text"))
-    .def("parse2", &FastMatch::parseBind2, py::arg("text"))
-    .def("max_forward_match", (SEG (FastMatch::*)(const string&) const)
-        (&FastMatch::maxForwardMatch), py::arg("text"));
+    .def(py::init<const string&, size_t, int>(), py::arg("path"), py::arg("capacity") = 0,
+        py::arg("num_threads") = 1)
+    .def(py::init<const vector<string>&, int>(), py::arg("key"), py::arg("num_threads") = 1)
+    .def("size", Reader(&FastMatch::size))
+    .def("num_keys", Reader(&FastMatch::num_keys))
+    .def("build_automaton", Writer(&FastMatch::buildAutomaton))
+    .def("has_automaton", Reader(&FastMatch::hasAutomaton))
+    .def("build_teddy", Writer(&FastMatch::buildTeddy))
+    .def("has_teddy", Reader(&FastMatch::hasTeddy))
+    .def("freeze", Writer(&FastMatch::freeze))
+    .def("frozen", Reader(&FastMatch::frozen))
+    .def("compact_keys", Writer(&FastMatch::compactKeys))
+    .def("compact", Reader(&FastMatch::compact))
+    .def("relayout", Writer(&FastMatch::relayout), py::arg("sample") = vector<string>())
+    .def("memory_usage", [](const SharedFastMatch& fm) {
+      return ToDict(Read(fm, [&] { return fm.memoryUsage(); }));
+    })
+    .def("shrink", Writer(&FastMatch::shrink), py::arg("finalize") = false)
+    .def("set_pages", Writer(&FastMatch::setPages), py::arg("pages"))
+    .def("pages", Reader(&trie::pages))
+    .def("insert", Writer(&FastMatch::insert), py::arg("key"))
+    .def("remove", Writer(&FastMatch::remove), py::arg("key"))
+    .def("save", Reader(&FastMatch::save), py::arg("path"))
+    .def("load", Writer(&FastMatch::load), py::arg("path"), py::arg("verify") = false)
+    .def("get_key", Reader(&FastMatch::getKey), py::arg("id"))
+    .def("get_value", Reader(&FastMatch::getValue), py::arg("key"))
+    .def("hit", Reader(&FastMatch::hit), py::arg("text"))
+    .def("parse", Reader(&FastMatch::parseBind), py::arg("text"))
+    .def("parse2", Reader(&FastMatch::parseBind2), py::arg("text"))
+    .def("max_forward_match", Reader((SEG (FastMatch::*)(text_ref) const)
+        (&FastMatch::maxForwardMatch)), py::arg("text"))
+    .def("hit_batch", Reader(&FastMatch::hitBatch), py::arg("texts"), py::arg("num_threads") = 0)
+    .def("parse_batch", Reader(&FastMatch::parseBatch), py::arg("texts"),
+        py::arg("num_threads") = 0)
+    .def("parse2_batch", Reader(&FastMatch::parse2Batch), py::arg("texts"),
+        py::arg("num_threads") = 0)
+    .def("max_forward_match_batch", Reader(&FastMatch::maxForwardMatchBatch), py::arg("texts"),
+        py::arg("num_threads") = 0)
+    .def("parse_columns", [](const SharedFastMatch& fm, const string& text) {
+      return ToDict(Read(fm, [&] { return fm.parseColumns(text, false); }));
+    }, py::arg("text"))
+    .def("parse2_columns", [](const SharedFastMatch& fm, const string& text) {
+      return ToDict(Read(fm, [&] { return fm.parseColumns(text, true); }));
+    }, py::arg("text"))
+    .def("parse_columns_batch", [](const SharedFastMatch& fm, const vector<string>& texts,
+        int num_threads) {
+      return ToDict(Read(fm, [&] { return fm.parseColumnsBatch(texts, false, num_threads); }));
+    }, py::arg("texts"), py::arg("num_threads") = 0)
+    .def("parse2_columns_batch", [](const SharedFastMatch& fm, const vector<string>& texts,
+        int num_threads) {
+      return ToDict(Read(fm, [&] { return fm.parseColumnsBatch(texts, true, num_threads); }));
+    }, py::arg("texts"), py::arg("num_threads") = 0);
 }
-